@@ -0,0 +1,70 @@
+# Compares hashing keys one at a time with the bulk murmurHash64A on asset-path-like strings, and
+# one-shot hashing of a large buffer with MurmurHasher fed in chunks. Checks that all of them agree.
+# Doesn't need The Machinery, run with `nimble benchmurmur`.
+import std / [monotimes, times, strformat, random]
+
+import "../tm/foundation/murmur2"
+
+const
+  numKeys = 1_000_000
+  rounds = 5
+  bufferSize = 256 * 1024 * 1024
+
+proc makeKeys(): seq[string] =
+  const dirs = ["core", "textures", "materials", "entities", "audio", "prefabs/props"]
+  var rng = initRand(1234)
+  for i in 0 ..< numKeys:
+    var s = dirs[rng.rand(dirs.high)] & "/"
+    for _ in 0 ..< rng.rand(4 .. 40): s.add char(ord('a') + rng.rand(25))
+    s.add [".tm_entity", ".tm_creation", ".tm_material"][rng.rand(2)]
+    result.add s
+
+template timed(body: untyped): float =
+  let start = getMonoTime()
+  body
+  (getMonoTime() - start).inNanoseconds.float / 1e6
+
+proc main() =
+  doAssert murmurHash64A("tm_vec2_t") == 0x5ea1bb7b6537de46'u64
+  doAssert murmurHash64A("") == murmurHash64A(nil, 0)
+
+  let keys = makeKeys()
+  var bytes = 0
+  for k in keys: bytes += k.len
+  var scalar, bulk = newSeq[uint64](keys.len)
+  var scalarMs, bulkMs = high(float)
+  for _ in 0 ..< rounds:
+    let s = timed:
+      for i, k in keys: scalar[i] = murmurHash64A(k)
+    let b = timed:
+      murmurHash64A(keys, bulk)
+    scalarMs = min(scalarMs, s)
+    bulkMs = min(bulkMs, b)
+  doAssert scalar == bulk
+  echo &"{numKeys} keys, {bytes} bytes"
+  echo &"  one at a time: {scalarMs:8.2f} ms  {numKeys.float / scalarMs / 1e3:6.1f} Mkeys/s"
+  echo &"  {MurmurLanes} lanes:       {bulkMs:8.2f} ms  {numKeys.float / bulkMs / 1e3:6.1f} Mkeys/s"
+
+  var buffer = newSeq[byte](bufferSize)
+  var rng = initRand(42)
+  for i in 0 ..< bufferSize div 8:
+    let x = rng.next()
+    copyMem(buffer[i * 8].addr, x.unsafeAddr, 8)
+  var oneShot, streamed: uint64
+  let oneShotMs = timed:
+    # Offset by one byte so every block load is unaligned.
+    oneShot = murmurHash64A(buffer[1].addr, bufferSize - 1)
+  let streamedMs = timed:
+    var hasher = initMurmurHasher(bufferSize - 1)
+    var pos = 1
+    while pos < bufferSize:
+      let n = min(65_539, bufferSize - pos) # odd chunks, so blocks straddle them
+      hasher.update(buffer[pos].addr, n)
+      pos += n
+    streamed = hasher.finish()
+  doAssert oneShot == streamed
+  echo &"{bufferSize div (1024 * 1024)} MiB buffer"
+  echo &"  one shot:      {oneShotMs:8.2f} ms  {bufferSize.float / oneShotMs / 1e6:6.2f} GB/s"
+  echo &"  streamed:      {streamedMs:8.2f} ms  {bufferSize.float / streamedMs / 1e6:6.2f} GB/s"
+
+main()
@@ -0,0 +1,63 @@
+# Runs parallelWalk over a stand-in Truth: a synthetic asset graph with subobject trees and
+# cross references, so the walker can be checked and timed on any platform without The Machinery.
+# Run with `nimble benchwalk`.
+import std / [monotimes, times, strformat, random, sets, cpuinfo]
+when compileOption("threads"):
+  import std / locks
+  when (NimMajor, NimMinor) >= (1, 9):
+    import std / typedthreads
+
+include "../tm/foundation/parallel_walk"
+
+type
+  FakeTruth = object
+    subobjects: seq[seq[uint64]] # per object, like subobject sets
+    references: seq[seq[uint64]] # per object, may point anywhere, including cycles
+    payload: seq[uint32]
+
+proc children(t: FakeTruth, id: uint64, dst: var seq[uint64]) =
+  dst.add t.subobjects[id.int]
+  dst.add t.references[id.int]
+
+proc makeTruth(numObjects, fanout: int): FakeTruth =
+  var rng = initRand(1234)
+  result.subobjects.setLen(numObjects)
+  result.references.setLen(numObjects)
+  result.payload.setLen(numObjects)
+  # Object i owns objects i * fanout + 1 .. i * fanout + fanout, a tree rooted at 0.
+  for i in 0 ..< numObjects:
+    for k in 1 .. fanout:
+      let c = i * fanout + k
+      if c < numObjects: result.subobjects[i].add c.uint64
+    if rng.rand(3) == 0:
+      result.references[i].add rng.rand(numObjects - 1).uint64
+    result.payload[i] = rng.rand(high(int32)).uint32
+
+type Stats = object
+  visited: int
+  checksum: uint64
+
+proc visit(t: FakeTruth, id: uint64, s: var Stats) =
+  # Stands in for reading and validating the object's properties.
+  var h = t.payload[id.int].uint64
+  for _ in 0 ..< 200:
+    h = (h xor (h shr 33)) * 0xff51afd7ed558ccd'u64
+  inc s.visited
+  s.checksum += h
+
+proc merge(into: var Stats, part: Stats) =
+  into.visited += part.visited
+  into.checksum += part.checksum
+
+const numObjects = 1_000_000
+
+let truth = makeTruth(numObjects, 4)
+var expected: Stats
+for workers in [1, 2, 4, 8]:
+  let start = getMonoTime()
+  let s = parallelWalk(truth, 0'u64, visit, merge, workers)
+  let ms = (getMonoTime() - start).inMicroseconds.float / 1000
+  doAssert s.visited == numObjects, &"visited {s.visited} of {numObjects}"
+  if workers == 1: expected = s
+  doAssert s.checksum == expected.checksum, "workers visited different objects"
+  echo &"{workers} workers: {ms:10.2f} ms"
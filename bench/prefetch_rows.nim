@@ -0,0 +1,83 @@
+# Compares a plain lockstep loop with `PrefetchStreams` on archetype-sized arrays laid out like
+# tm_engine_update_array_t: a 24 byte custom component, a ~100 byte transform and the entity ids.
+# Doesn't need The Machinery, run with `nimble benchprefetch`.
+import std / [monotimes, times, strformat, math]
+
+include "../tm/foundation/prefetch"
+
+type
+  Custom = object
+    y0, frequency, amplitude: float
+  Transform = object # roughly the size of tm_transform_component_t
+    pos, scl: array[3, float32]
+    rot: array[4, float32]
+    world: array[10, float32]
+    version: uint32
+  Unused = object # read-only component the loop doesn't touch
+    data: array[16, float32]
+
+  Archetype = object
+    n: int
+    custom: ptr UncheckedArray[Custom]
+    transform: ptr UncheckedArray[Transform]
+    unused: ptr UncheckedArray[Unused]
+    entities: ptr UncheckedArray[uint64]
+
+const
+  rowsPerArchetype = 1 shl 16
+  numArchetypes = 64 # ~12 MiB per archetype group, well past the last level cache
+  frames = 20
+
+proc alloc[T](n: int): ptr UncheckedArray[T] =
+  cast[ptr UncheckedArray[T]](allocShared0(n * sizeof(T)))
+
+proc makeArchetypes(): seq[Archetype] =
+  for k in 0 ..< numArchetypes:
+    var a = Archetype(n: rowsPerArchetype, custom: alloc[Custom](rowsPerArchetype),
+      transform: alloc[Transform](rowsPerArchetype), unused: alloc[Unused](rowsPerArchetype),
+      entities: alloc[uint64](rowsPerArchetype))
+    for i in 0 ..< a.n:
+      a.custom[i] = Custom(y0: float(i mod 7), frequency: 1.0 + float(i mod 3), amplitude: 0.5)
+      a.entities[i] = uint64(k * rowsPerArchetype + i)
+    result.add a
+
+template body(a: Archetype, i: int, t: float, sum: var uint64) =
+  let c = a.custom[i].addr
+  let tr = a.transform[i].addr
+  tr.pos[1] = float32(c.y0 + c.amplitude * sin(t * c.frequency))
+  tr.world[0] = tr.pos[1]
+  inc tr.version
+  sum += a.entities[i]
+
+proc plain(archetypes: seq[Archetype], t: float): uint64 =
+  for a in archetypes:
+    for i in 0 ..< a.n:
+      body(a, i, t, result)
+
+proc prefetched(archetypes: seq[Archetype], t: float, withUnused: bool): uint64 =
+  for a in archetypes:
+    var s = initPrefetchStreams[4](a.n)
+    s.add(a.custom, sizeof(Custom))
+    s.add(a.transform, sizeof(Transform))
+    if withUnused:
+      s.add(a.unused, sizeof(Unused))
+    s.add(a.entities, sizeof(uint64))
+    for i in s.rows(distance = 8):
+      body(a, i, t, result)
+
+proc run(name: string, f: proc (t: float): uint64) =
+  var
+    best = high(int64)
+    check: uint64
+  for frame in 0 ..< frames:
+    let start = getMonoTime()
+    check += f(float(frame) * 0.016)
+    best = min(best, (getMonoTime() - start).inNanoseconds)
+  let rows = numArchetypes * rowsPerArchetype
+  echo &"{name:<28} {best.float / 1e6:8.3f} ms  {best.float / rows.float:6.2f} ns/row  ({check})"
+
+let archetypes = makeArchetypes()
+echo &"{numArchetypes} archetypes x {rowsPerArchetype} rows, best of {frames} frames"
+run("mrows-style lockstep", proc (t: float): uint64 = plain(archetypes, t))
+run("prefetchRows", proc (t: float): uint64 = prefetched(archetypes, t, false))
+run("prefetchRows + unused", proc (t: float): uint64 = prefetched(archetypes, t, true))
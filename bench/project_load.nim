@@ -0,0 +1,113 @@
+# Times loading a project with the offline tools: tokenizing every asset, building and refreshing
+# the UUID index, resolving every object's prototype chain and verifying the buffers. Runs on tm_proj
+# and on copies scaled up with tm_proj_scale, and prints the results as JSON for trend tracking.
+# Doesn't need The Machinery, run with
+# `nimble benchload -- [--sizes:0,10000,100000] [--rounds:3] [--workers:0] [--out:file.json]`.
+# Size 0 is tm_proj itself; scaled copies go to the temp directory and are reused between runs.
+import std / [os, json, monotimes, times, strformat, strutils, sequtils, parseopt, cpuinfo]
+import "../tools" / [tm_text, tm_project, tm_uuid_index, tm_buffers_check, tm_proj_scale, work_pool]
+
+const fixture = currentSourcePath.parentDir / ".." / "tm_proj"
+
+type
+  TokenizeJob = object
+    dir: string
+    files: seq[string]
+    tokens, bytes: seq[int] # per worker
+
+proc tokenizeOne(job: ptr TokenizeJob, i, worker: int) {.nimcall, gcsafe.} =
+  var f = openTextFile(job.dir / job.files[i])
+  defer: f.close()
+  var
+    t = initTextTokenizer(f)
+    tok: Token
+  while t.next(tok): inc job.tokens[worker]
+  job.bytes[worker] += f.data.len
+
+template timed(body: untyped): float =
+  let start = getMonoTime()
+  body
+  (getMonoTime() - start).inNanoseconds.float / 1e6
+
+proc benchProject(dir: string, rounds, workers: int): JsonNode =
+  let files = projectFiles(dir)
+  let indexPath = getTempDir() / &"tm_bench_{dir.extractFilename}.tm_uuid_index"
+  var
+    best = [high(float), high(float), high(float), high(float), high(float)]
+    tokens, bytes, objects, prototypes, buffers: int
+  for _ in 0 ..< rounds:
+    var job = TokenizeJob(dir: dir, files: files)
+    job.tokens.setLen(poolSize(files.len, workers))
+    job.bytes.setLen(job.tokens.len)
+    let tokenize = timed:
+      parallelFor(job.addr, files.len, tokenizeOne, workers)
+    tokens = 0
+    bytes = 0
+    for w in 0 ..< job.tokens.len:
+      tokens += job.tokens[w]
+      bytes += job.bytes[w]
+
+    removeFile(indexPath)
+    let index = timed:
+      discard buildUuidIndex(dir, indexPath, workers)
+    let refresh = timed:
+      discard buildUuidIndex(dir, indexPath, workers)
+
+    var ix = openUuidIndex(indexPath)
+    let resolve = timed:
+      prototypes = 0
+      for i in 0 ..< ix.numEntries:
+        for _ in ix.prototypeChain(ix.entry(i).uuid): inc prototypes
+    objects = ix.numEntries
+    prototypes -= objects # links followed beyond the objects themselves
+    ix.close()
+
+    var report: BufferReport
+    let verify = timed:
+      report = checkBuffers(dir, workers)
+    buffers = report.buffers.len
+
+    for k, ms in [tokenize, index, refresh, resolve, verify]: best[k] = min(best[k], ms)
+  removeFile(indexPath)
+
+  %*{
+    "project": dir, "assets": files.len, "bytes": bytes, "tokens": tokens, "objects": objects,
+    "prototype_links": prototypes, "buffers": buffers,
+    "ms": {
+      "tokenize": best[0], "uuid_index": best[1], "uuid_index_refresh": best[2],
+      "prototype_resolution": best[3], "buffer_verification": best[4]
+    }
+  }
+
+proc main() =
+  var
+    sizes = @[0, 10_000, 100_000]
+    rounds = 3
+    workers = 0
+    output = ""
+  for kind, key, val in getopt():
+    if kind == cmdArgument: quit &"unexpected argument {key}"
+    case key
+    of "sizes": sizes = val.split(',').mapIt(parseInt(it.strip))
+    of "rounds": rounds = max(1, parseInt(val))
+    of "workers": workers = parseInt(val)
+    of "out": output = val
+    else: quit &"unknown option {key}"
+
+  var results = newJArray()
+  for size in sizes:
+    var dir = fixture
+    if size > 0:
+      dir = getTempDir() / &"tm_proj_{size}"
+      let stats = scaleProject(fixture, dir, size, workers)
+      if not stats.reused: stderr.writeLine &"generated {dir}: {stats.assets} assets"
+    stderr.writeLine &"timing {dir}"
+    results.add benchProject(dir, rounds, workers)
+
+  let doc = %*{
+    "benchmark": "project_load", "time": $now().utc, "nim": NimVersion,
+    "cpus": countProcessors(), "workers": workerCount(workers), "rounds": rounds, "results": results
+  }
+  if output.len > 0: writeFile(output, doc.pretty & "\n") else: echo doc.pretty
+
+main()
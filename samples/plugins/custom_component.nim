@@ -16,11 +16,11 @@ const
   TtTypeCustomComponent = "custom_component"
   TtTypeHashCustomComponent = TM_STATIC_HASH(TtTypeCustomComponent)
 
-type
-  CustomComponentE = enum
-    Frequency
-    Amplitude
+truthObject CustomComponentAsset:
+  frequency: float32 = 2.0
+  amplitude: float32 = 1.0
 
+type
   CustomComponentT = object
     y0, frequency, amplitude: float
   
@@ -31,22 +31,19 @@ var editor_aspect = tm_ci_editor_ui_i(category: componentCategory)
 
 # Use the "tm_type" pragma to map our proc to a TM function typedef (note TM's function typedef is not a function pointer!)
 proc truthCreateTypes(tt: ptr tm_the_truth_o) {.cdecl, tmType: tm_the_truth_create_types_i.}  =
-  var customComponentProperties = [
-    tmTheTruthPropertyDefinitionT(name: "frequency", `type`: TM_THE_TRUTH_PROPERTY_TYPE_FLOAT),
-    tmTheTruthPropertyDefinitionT(name: "amplitude", `type`: TM_THE_TRUTH_PROPERTY_TYPE_FLOAT)
-  ]
-
-  let 
-    customComponentType = truthApi.create_object_type(tt, TtTypeCustomComponent, customComponentProperties[0].addr, customComponentProperties.len.uint32)
-    defaultObject = truthApi.quick_create_object(tt, TM_TT_NO_UNDO_SCOPE, TtTypeHashCustomComponent, Frequency, 2.0, Amplitude, 1.0, -1)
-  truthApi.set_default_object(tt, customComponentType, defaultObject)
+  let customComponentType = truthApi.createObjectType(tt, CustomComponentAsset, TtTypeCustomComponent)
   truthApi.set_aspect(tt, customComponentType, TM_CI_EDITOR_UI, editor_aspect.addr)
 
 
+# entity.components[transform].local_position.y
+var localY = truthPath(float32, [
+  viaSetOfType(TM_TT_PROP_ENTITY_COMPONENTS, TM_TT_TYPE_HASH_TRANSFORM_COMPONENT),
+  viaSubobject(TM_TT_PROP_TRANSFORM_COMPONENT_LOCAL_POSITION)],
+  TM_TT_PROP_POSITION_Y)
+
 proc componentLoadAsset(manager: ptr tm_component_manager_o, commands: ptr tm_entity_commands_o, e: tm_entity_t, compData: pointer, tt: ptr tm_the_truth_o, compAsset: tm_tt_id_t): bool {.cdecl.} =
   var 
     c = cast[ptr CustomComponentT](compData)
-    compAssetR: ptr tm_the_truth_object_o = truthApi.read(tt, compAsset)
     ownerAsset: tm_tt_id_t = truthApi.owner(tt, compAsset)
 
   #[
@@ -57,11 +54,11 @@ proc componentLoadAsset(manager: ptr tm_component_manager_o, commands: ptr tm_en
   let pos = truthCommonTypesApi.get_position(tt, truthApi.read(tt, trAsset), TM_TT_PROP_TRANSFORM_COMPONENT_LOCAL_POSITION.uint32)
   ]#
 
-  let y = truthApi.quick_get_property(tt, ownerAsset, TM_TT_PROP_ENTITY_COMPONENTS, 0, TM_TT_PROP_TRANSFORM_COMPONENT_LOCAL_POSITION, 1, -1).f32
-  c.y0 = y
+  c.y0 = localY.get(truthApi, tt, ownerAsset)
   
-  c.frequency = truthApi.get_float(tt, compAssetR, Frequency.uint32)
-  c.amplitude = truthApi.get_float(tt, compAssetR, Amplitude.uint32)
+  let asset = CustomComponentAsset.read(truthApi, tt, compAsset)
+  c.frequency = asset.frequency
+  c.amplitude = asset.amplitude
   true
 
 proc componentAssetReloaded(man: ptr tm_component_manager_o, commands: ptr tm_entity_commands_o, e: tm_entity_t, data: pointer) {.cdecl.} =
@@ -76,22 +73,28 @@ proc componentCreate(ctx: ptr tm_entity_context_o) {.cdecl, tmType: tm_entity_cr
     )
   discard entityApi.register_component(ctx, component.addr)
 
+blackboard EngineBlackboard:
+  time: float64 = TM_ENTITY_BB_TIME
+
 proc engineUpdateCustom(inst: ptr tm_engine_o, data: ptr tm_engine_update_set_t, commands: ptr tm_entity_commands_o) {.cdecl.} =
   var 
     ta = tempAllocatorApi.init()
     modTransform: ptr tm_entity_t
     ctx = cast[ptr tm_entity_context_o](inst)
-    t = 0'f64
- 
-  for bb in items(data.blackboardStart, data.blackboardEnd):
-    if bb.id == TM_ENTITY_BB_TIME: 
-      t = bb.doubleValue
+    bb: EngineBlackboard # local: updates of different entity contexts can run at the same time
+
+  bb.read(data)
+  let t = bb.time
 
   for a in items(data.arrays, data.numArrays):
     var
       custom = cast[ptr CustomComponentT](a.components[0])
       transform = cast[ptr tm_transform_component_t](a.components[1])
-    for _, c, tr, e in mrows(custom, transform, a.entities, a.n):
+    for i in prefetchRows(a, {0, 1}):
+      let
+        c = custom + i
+        tr = transform + i
+        e = a.entities[i]
       let y = c.y0 + c.amplitude * sin(float(t) * c.frequency)
       tr.world.pos.x = y
       tr.world.pos.y = sin(float(t) * 30.5 )*0.08323f + c.y0
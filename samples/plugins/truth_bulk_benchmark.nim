@@ -0,0 +1,64 @@
+import tm
+import std / [monotimes, times]
+import strformat
+
+# Times creating a large import with quick_create_object (one write + commit per object) against
+# createObjects (one commit_range under one undo scope). Results are logged when the plugin loads.
+
+const
+  version = TmVersion(0, 1, 0)
+  numObjects = 50_000
+  TtTypeBenchRecord = "tm_nim_bench_record"
+  TtTypeHashBenchRecord = TM_STATIC_HASH(TtTypeBenchRecord)
+
+truthObject BenchRecord:
+  weight: float32
+  scale: float64
+  count: uint32
+  enabled: bool
+
+var
+  truthApi: ptr tm_the_truth_api
+  log: ptr tm_logger_api
+
+proc records(): seq[BenchRecord] =
+  result = newSeq[BenchRecord](numObjects)
+  for i, r in result.mpairs:
+    r = BenchRecord(weight: float32(i) * 0.5, scale: float(i mod 13), count: uint32(i), enabled: i mod 2 == 0)
+
+proc timed(name: string, allocator: ptr tm_allocator_i, body: proc (tt: ptr tm_the_truth_o)) =
+  let tt = truthApi.create(allocator, TM_THE_TRUTH_CREATE_TYPES_NONE)
+  discard truthApi.createObjectType(tt, BenchRecord, TtTypeBenchRecord)
+  discard truthApi.request_changelog(tt)
+  let start = getMonoTime()
+  body(tt)
+  let ms = (getMonoTime() - start).inMicroseconds.float / 1000
+  log.info(&"{name:<40} {numObjects} objects {ms:10.2f} ms")
+  truthApi.destroy(tt)
+
+proc init(p: ptr tm_plugin_o, allocator: ptr tm_allocator_i) {.cdecl.} =
+  let rs = records()
+  timed("quick_create_object", allocator) do (tt: ptr tm_the_truth_o):
+    let undo = truthApi.create_undo_scope(tt, "Import")
+    for r in rs:
+      discard truthApi.quick_create_object(tt, undo, TtTypeHashBenchRecord, Weight, r.weight.float64,
+        Scale, r.scale, Count, r.count, Enabled, r.enabled, -1)
+
+  timed("createObjects", allocator) do (tt: ptr tm_the_truth_o):
+    discard rs.createObjects(truthApi, tt, TtTypeHashBenchRecord, "Import")
+
+  timed("createObjects, changelog disabled", allocator) do (tt: ptr tm_the_truth_o):
+    discard rs.createObjects(truthApi, tt, TtTypeHashBenchRecord, "Import", disableChangelog = true)
+
+var initI = tm_plugin_init_i(init: init)
+
+proc tm_load_plugin(reg: ptr tm_api_registry_api, load: bool) {.callback.} =
+  if load:
+    NimMain()
+
+  reg.get_api_for truthApi, log
+
+  if load:
+    log.info(&"truth bulk benchmark {version}")
+
+  reg.add_or_remove_impl load, initI
@@ -0,0 +1,91 @@
+import tm
+import std / [monotimes, times, os]
+import strformat
+
+# Round-trips a large prefab (one root with a set of 50k subobjects) through a file, copying the
+# serialize() carray into Nim strings against the arena + chunked stream path. Results are logged
+# when the plugin loads.
+
+const
+  version = TmVersion(0, 1, 0)
+  numChildren = 50_000
+  rounds = 5
+  TtTypeBenchRecord = "tm_nim_bench_record"
+  TtTypeHashBenchRecord = TM_STATIC_HASH(TtTypeBenchRecord)
+  TtTypeBenchPrefab = "tm_nim_bench_prefab"
+  TtTypeHashBenchPrefab = TM_STATIC_HASH(TtTypeBenchPrefab)
+
+truthObject BenchRecord:
+  weight: float32
+  scale: float64
+  count: uint32
+  name: string
+
+var
+  truthApi: ptr tm_the_truth_api
+  log: ptr tm_logger_api
+
+proc createTypes(tt: ptr tm_the_truth_o) =
+  discard truthApi.createObjectType(tt, BenchRecord, TtTypeBenchRecord)
+  var props = [tmTheTruthPropertyDefinitionT(name: "children", `type`: TM_THE_TRUTH_PROPERTY_TYPE_SUBOBJECT_SET,
+    typeHash: TtTypeHashBenchRecord)]
+  discard truthApi.create_object_type(tt, TtTypeBenchPrefab, props[0].addr, props.len.uint32)
+
+proc createPrefab(tt: ptr tm_the_truth_o): tm_tt_id_t =
+  var records = newSeq[BenchRecord](numChildren)
+  for i, r in records.mpairs:
+    r = BenchRecord(weight: float32(i), scale: float(i mod 17), count: uint32(i), name: &"child {i}")
+  let children = records.createObjects(truthApi, tt, TtTypeHashBenchRecord).ids
+  result = truthApi.create_object_of_hash(tt, TtTypeHashBenchPrefab, TM_TT_NO_UNDO_SCOPE)
+  let w = truthApi.write(tt, result)
+  truthApi.add_to_subobject_set_id(tt, w, 0, children[0].addr, children.len.uint32, TM_TT_NO_UNDO_SCOPE)
+  truthApi.commit(tt, w, TM_TT_NO_UNDO_SCOPE)
+
+proc timed(name: string, body: proc ()) =
+  let start = getMonoTime()
+  for _ in 0 ..< rounds:
+    body()
+  let ms = (getMonoTime() - start).inMicroseconds.float / 1000 / rounds
+  log.info(&"{name:<28} {ms:10.2f} ms per round trip")
+
+proc init(p: ptr tm_plugin_o, allocator: ptr tm_allocator_i) {.cdecl.} =
+  let
+    tt = truthApi.create(allocator, TM_THE_TRUTH_CREATE_TYPES_NONE)
+    path = getTempDir() / "tm_nim_bench_prefab.bin"
+  createTypes(tt)
+  let prefab = createPrefab(tt)
+
+  timed("carray copied to string") do ():
+    var
+      buf: ptr char
+      opts: tm_tt_serialize_options_t
+      dopts: tm_tt_deserialize_options_t
+    truthApi.serialize(tt, prefab, buf.addr, allocator, opts.addr)
+    var s = newString(tm_carray_size(buf).int)
+    copyMem(s[0].addr, buf, s.len)
+    discard tm_carray_set_capacity_internal(buf, 0, 1, allocator, "truth_serialize_benchmark.nim", 0)
+    writeFile(path, s)
+    let data = readFile(path)
+    var cursor = data.cstring
+    discard truthApi.deserialize(tt, cursor.addr, dopts.addr)
+
+  var arena = initSerializeArena(allocator, 32 shl 20)
+  timed("arena + chunked stream") do ():
+    arena.serializeToFile(truthApi, tt, [prefab], path)
+    discard truthApi.deserializeFile(tt, path)
+
+  removeFile(path)
+  truthApi.destroy(tt)
+
+var initI = tm_plugin_init_i(init: init)
+
+proc tm_load_plugin(reg: ptr tm_api_registry_api, load: bool) {.callback.} =
+  if load:
+    NimMain()
+
+  reg.get_api_for truthApi, log
+
+  if load:
+    log.info(&"truth serialize benchmark {version}")
+
+  reg.add_or_remove_impl load, initI
@@ -0,0 +1,96 @@
+type
+  BufferView*[T] = object
+    ## Typed, zero-copy view of a buffer in a ``tm_buffers_i``. Holds a reference on the buffer
+    ## (``retain``) that is released when the view is destroyed, so the data stays valid for the
+    ## lifetime of the view. Copies retain again.
+    ## Ex:
+    ## let verts = truthApi.bufferView[:Vertex](tt, r, Vertices.uint32)
+    ## for v in verts.toOpenArray: ...
+    buffers: ptr tm_buffers_i
+    id: uint32
+    data*: ptr UncheckedArray[T]
+    len*: int
+
+proc `=destroy`*[T](v: var BufferView[T]) =
+  if v.buffers != nil and v.id != 0:
+    v.buffers.release(v.buffers.inst, v.id)
+
+proc `=copy`*[T](dst: var BufferView[T], src: BufferView[T]) =
+  if dst.buffers == src.buffers and dst.id == src.id: return
+  `=destroy`(dst)
+  wasMoved(dst)
+  if src.buffers != nil and src.id != 0:
+    src.buffers.retain(src.buffers.inst, src.id)
+  dst.buffers = src.buffers
+  dst.id = src.id
+  dst.data = src.data
+  dst.len = src.len
+
+proc bufferView*[T](buffers: ptr tm_buffers_i, id: uint32): BufferView[T] =
+  ## Retains buffer `id` and views its content as `T`s. A trailing partial `T` is not included.
+  ## Loads the buffer first if it is a streamable buffer that isn't loaded yet.
+  if id == 0: return
+  buffers.retain(buffers.inst, id)
+  var size: uint64
+  let p = buffers.get(buffers.inst, id, size.addr)
+  BufferView[T](buffers: buffers, id: id, data: cast[ptr UncheckedArray[T]](p), len: int(size div sizeu64(T)))
+
+proc bufferView*[T](buffers: ptr tm_streamable_buffers_i, id: uint32): BufferView[T] {.inline.} =
+  # tm_streamable_buffers_i starts with the tm_buffers_i interface (TM_INHERITS)
+  bufferView[T](cast[ptr tm_buffers_i](buffers), id)
+
+proc bufferView*[T](api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, r: ptr tm_the_truth_object_o,
+    property: uint32): BufferView[T] =
+  ## View of a buffer property of the read object `r`.
+  bufferView[T](api.buffers(tt), api.get_buffer_id(tt, r, property))
+
+proc id*[T](v: BufferView[T]): uint32 {.inline.} =
+  v.id
+
+proc bytes*[T](v: BufferView[T]): int {.inline.} =
+  v.len * sizeof(T)
+
+proc `[]`*[T](v: BufferView[T], i: int): lent T {.inline.} =
+  assert(i >= 0 and i < v.len, "buffer view index out of bounds")
+  v.data[i]
+
+template toOpenArray*[T](v: BufferView[T]): openArray[T] =
+  ## The view as an ``openArray``, valid while `v` is alive.
+  toOpenArray(v.data, 0, v.len - 1)
+
+iterator items*[T](v: BufferView[T]): lent T =
+  for i in 0 ..< v.len:
+    yield v.data[i]
+
+proc mapFile*(buffers: ptr tm_streamable_buffers_i, path: string, offset = 0'u64, size = 0'u64, hash = 0'u64): uint32 {.inline.} =
+  ## Creates an unloaded streamable buffer backed by (`offset`, `size`) of the file at `path`.
+  ## A `size` of 0 maps the whole file.
+  buffers.map(buffers.inst, path.cstring, offset, size, hash)
+
+iterator streamViews*[T](buffers: ptr tm_streamable_buffers_i, ids: openArray[uint32],
+    background = true): tuple[index: int, view: BufferView[T]] =
+  ## Yields a view of each of `ids` (with its index in `ids`), as soon as it is in memory, so
+  ## large mapped buffers can be processed while others are still loading. With `background` the
+  ## loads are started with ``background_load_all``; whenever nothing is loaded yet, the next
+  ## buffer is loaded on this thread instead of waiting.
+  if background:
+    buffers.background_load_all(buffers.inst, nil)
+  var pending = newSeqOfCap[int](ids.len)
+  for i in 0 ..< ids.len:
+    pending.add i
+  while pending.len > 0:
+    var
+      i = 0
+      ready = false
+    while i < pending.len:
+      let k = pending[i]
+      if buffers.is_loaded(buffers.inst, ids[k]) or not buffers.is_mapped(buffers.inst, ids[k]):
+        pending.del(i)
+        ready = true
+        yield (k, bufferView[T](buffers, ids[k]))
+      else:
+        inc i
+    if not ready:
+      let k = pending[0]
+      pending.delete(0)
+      yield (k, bufferView[T](buffers, ids[k])) # get() loads it on demand
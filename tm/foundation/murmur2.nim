@@ -7,51 +7,144 @@ template `+`[T](p: ptr T, off: int): ptr T =
 template `[]`[T](p: ptr T, off: int): T =
   (p + off)[]
 
+const
+  m = 0xc6a4a7935bd1e995'u64
+  r = 47
+  MurmurLanes* = 4 ## keys hashed together by the bulk murmurHash64A
+
+proc load64(p: ptr uint8): uint64 {.inline.} =
+  # Blocks can be at any address; copyMem compiles to a plain unaligned load.
+  copyMem(result.addr, p, sizeof(uint64))
+
+proc mix(h: var uint64, k: uint64) {.inline.} =
+  var k = k
+  k *= m
+  k ^= k shr r
+  k *= m
+  h ^= k
+  h *= m
+
+proc mixTail(h: var uint64, tail: ptr uint8, n: int) {.inline.} =
+  # The last `n` < 8 bytes.
+  if n == 0: return
+  for i in countdown(n - 1, 0):
+    h ^= uint64(tail[i]) shl (8 * i)
+  h *= m
+
+proc finalize(h: uint64): uint64 {.inline.} =
+  result = h
+  result ^= result shr r
+  result *= m
+  result ^= result shr r
 
 proc murmurHash64A*(key: ptr uint8, len: int, seed: uint64 = 0): uint64 =
   ## MurmurHash2
   ## https://github.com/aappleby/smhasher/blob/master/src/MurmurHash2.cpp
-  let m = 0xc6a4a7935bd1e995'u64
-  let r = 47
-
   var h = seed xor uint64(uint64(len) * m)
-
-  let blocks = cast[ptr uint64](key)
   let nblocks = len div sizeof(uint64)
-
   for i in 0 ..< nblocks:
-    var k = blocks[i]
-    # echo &"i,k: {i},{k}"
-    k *= m
-    k ^= k shr r
-    k *= m
-    h ^= k
-    h *= m
-
-  let tail = key + nblocks * sizeof(uint64)
-  var state = len and 7
-  while state > 0:
-    case state:
-    of 7: h ^= uint64(tail[6]) shl 48
-    of 6: h ^= uint64(tail[5]) shl 40
-    of 5: h ^= uint64(tail[4]) shl 32
-    of 4: h ^= uint64(tail[3]) shl 24
-    of 3: h ^= uint64(tail[2]) shl 16
-    of 2: h ^= uint64(tail[1]) shl 8
-    of 1:
-      h ^= uint64(tail[0])
+    h.mix(load64(key + i * sizeof(uint64)))
+  h.mixTail(key + nblocks * sizeof(uint64), len and 7)
+  finalize(h)
+
+proc murmurHash64A*(x: string, seed = 0'u64): uint64 =
+  ## Ex: murmurHash64A("tm_vec2_t") == 0x5ea1bb7b6537de46'u64
+  when nimvm:
+    # Same hash without pointers, for TM_STATIC_HASH.
+    var h = seed xor uint64(uint64(x.len) * m)
+    let nblocks = x.len div 8
+    for i in 0 ..< nblocks:
+      var k = 0'u64
+      for b in 0 ..< 8:
+        k = k or uint64(x[i * 8 + b]) shl (8 * b)
+      h.mix(k)
+    let tail = x.len and 7
+    if tail > 0:
+      for i in countdown(tail - 1, 0):
+        h ^= uint64(x[nblocks * 8 + i]) shl (8 * i)
       h *= m
-    of 0: break
-    else:
-      assert false
-    dec(state)
+    finalize(h)
+  else:
+    if x.len == 0: murmurHash64A(nil, 0, seed)
+    else: murmurHash64A(cast[ptr uint8](x[0].unsafeAddr), x.len, seed)
 
-  h ^= h shr r
-  h *= m
-  h ^= h shr r
+proc murmurHash64A*(keys: openArray[string], hashes: var openArray[uint64], seed = 0'u64) =
+  ## Hashes every key of `keys` into `hashes`. Keys are hashed MurmurLanes at a time with their
+  ## block loops interleaved, so the lanes' independent multiply chains overlap; keys of similar
+  ## length (e.g. sorted by length) overlap the most.
+  ## Ex:
+  ## var hashes = newSeq[uint64](paths.len)
+  ## murmurHash64A(paths, hashes)
+  assert hashes.len >= keys.len
+  var i = 0
+  while i + MurmurLanes <= keys.len:
+    var
+      h: array[MurmurLanes, uint64]
+      p: array[MurmurLanes, ptr uint8]
+      common = high(int)
+    for l in 0 ..< MurmurLanes:
+      let len = keys[i + l].len
+      h[l] = seed xor uint64(uint64(len) * m)
+      p[l] = if len > 0: cast[ptr uint8](keys[i + l][0].unsafeAddr) else: nil
+      common = min(common, len div sizeof(uint64))
+    for b in 0 ..< common:
+      for l in 0 ..< MurmurLanes:
+        h[l].mix(load64(p[l] + b * sizeof(uint64)))
+    for l in 0 ..< MurmurLanes:
+      let len = keys[i + l].len
+      let nblocks = len div sizeof(uint64)
+      for b in common ..< nblocks:
+        h[l].mix(load64(p[l] + b * sizeof(uint64)))
+      h[l].mixTail(p[l] + nblocks * sizeof(uint64), len and 7)
+      hashes[i + l] = finalize(h[l])
+    i += MurmurLanes
+  for j in i ..< keys.len:
+    hashes[j] = murmurHash64A(keys[j], seed)
 
-  result = h
-  # echo &"{bytes},{seed} -> {result}"
+type
+  MurmurHasher* = object
+    ## Incremental murmurHash64A of `len` bytes fed in pieces of any size, for buffers that aren't
+    ## in memory at once. The hash mixes in the length first, so it has to be known up front.
+    h: uint64
+    len, fed: int
+    pending: array[8, uint8] # bytes of an incomplete block
+    numPending: int
+
+proc initMurmurHasher*(len: int, seed = 0'u64): MurmurHasher =
+  ## Ex:
+  ## var hasher = initMurmurHasher(getFileSize(path).int)
+  ## while (let n = f.readBuffer(chunk[0].addr, chunk.len); n > 0): hasher.update(chunk[0].addr, n)
+  ## let hash = hasher.finish()
+  MurmurHasher(h: seed xor uint64(uint64(len) * m), len: len)
+
+proc update*(s: var MurmurHasher, data: ptr uint8, len: int) =
+  ## Feeds the next `len` bytes.
+  var
+    p = data
+    n = len
+  s.fed += len
+  assert s.fed <= s.len
+  if s.numPending > 0:
+    let take = min(8 - s.numPending, n)
+    if take > 0: copyMem(s.pending[s.numPending].addr, p, take)
+    s.numPending += take
+    if s.numPending < 8: return
+    p = p + take
+    n -= take
+    s.h.mix(load64(s.pending[0].addr))
+    s.numPending = 0
+  let nblocks = n div sizeof(uint64)
+  for i in 0 ..< nblocks:
+    s.h.mix(load64(p + i * sizeof(uint64)))
+  s.numPending = n and 7
+  if s.numPending > 0: copyMem(s.pending[0].addr, p + nblocks * sizeof(uint64), s.numPending)
+
+proc update*(s: var MurmurHasher, data: openArray[byte]) =
+  if data.len > 0: s.update(cast[ptr uint8](data[0].unsafeAddr), data.len)
 
-proc murmurHash64A*(x: string, seed = 0'u64): auto =
-  murmurHash64A(cast[ptr uint8](x[0].addr), x.len, seed)
\ No newline at end of file
+proc finish*(s: MurmurHasher): uint64 =
+  ## The hash once all `len` bytes are fed, same as murmurHash64A over the whole data.
+  assert s.fed == s.len
+  var h = s.h
+  h.mixTail(s.pending[0].unsafeAddr, s.numPending)
+  finalize(h)
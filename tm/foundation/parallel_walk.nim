@@ -0,0 +1,127 @@
+# Parallel traversal of an object graph, such as the subobjects and references of a Truth object.
+# Doesn't depend on the generated bindings: the graph is any `S` with a
+# `children(s: S, id: uint64, dst: var seq[uint64])` proc, so it can be run against a stand-in.
+
+const VisitedShards = 64
+
+type
+  WalkVisitor*[S, R] = proc (source: S, id: uint64, res: var R) {.nimcall, gcsafe.}
+  WalkMerge*[R] = proc (into: var R, part: R) {.nimcall, gcsafe.}
+
+  VisitedSet = object
+    # Sharded by id so workers rarely contend on the same lock.
+    when compileOption("threads"):
+      locks: array[VisitedShards, Lock]
+    shards: array[VisitedShards, HashSet[uint64]]
+
+  WalkQueue = object
+    when compileOption("threads"):
+      lock: Lock
+      cond: Cond
+    ids: seq[uint64]
+    pending: int # queued + being visited, the walk is done when this reaches 0
+
+  Walk[S, R] = object
+    source: ptr S
+    visitor: WalkVisitor[S, R]
+    visited: VisitedSet
+    queue: WalkQueue
+
+  WalkWorker[S, R] = object
+    walk: ptr Walk[S, R]
+    res: R
+
+proc initVisitedSet(v: var VisitedSet) =
+  when compileOption("threads"):
+    for l in v.locks.mitems: initLock(l)
+
+proc deinitVisitedSet(v: var VisitedSet) =
+  when compileOption("threads"):
+    for l in v.locks.mitems: deinitLock(l)
+
+proc tryVisit(v: var VisitedSet, id: uint64): bool =
+  # *true* the first time `id` is seen.
+  let s = int((id * 0x9E3779B97F4A7C15'u64) shr 58) # Fibonacci hash to 6 bits
+  when compileOption("threads"):
+    withLock v.locks[s]:
+      result = not v.shards[s].containsOrIncl(id)
+  else:
+    result = not v.shards[s].containsOrIncl(id)
+
+when compileOption("threads"):
+  proc walkWorker[S, R](w: ptr WalkWorker[S, R]) {.thread.} =
+    mixin children
+    let
+      walk = w.walk
+      q = walk.queue.addr
+    var kids, fresh: seq[uint64]
+    while true:
+      var id: uint64
+      withLock q.lock:
+        while q.ids.len == 0 and q.pending > 0:
+          wait(q.cond, q.lock)
+        if q.ids.len == 0: break
+        id = q.ids.pop()
+
+      walk.visitor(walk.source[], id, w.res)
+      kids.setLen(0)
+      children(walk.source[], id, kids)
+      fresh.setLen(0)
+      for k in kids:
+        if walk.visited.tryVisit(k): fresh.add k
+
+      withLock q.lock:
+        q.ids.add fresh
+        q.pending += fresh.len - 1
+        if q.pending == 0 or fresh.len > 1: broadcast(q.cond)
+        elif fresh.len == 1: signal(q.cond)
+
+proc parallelWalk*[S, R](source: S, roots: openArray[uint64], visitor: WalkVisitor[S, R], merge: WalkMerge[R],
+    workers = 0): R =
+  ## Visits every object reachable from `roots` exactly once, spread over `workers` threads
+  ## (one per core if 0). Each worker accumulates into its own `R`, which are combined with
+  ## `merge` at the end. Visit order is unspecified. Runs on the calling thread when built
+  ## without ``--threads:on``.
+  ## Ex:
+  ## proc countMeshes(s: TruthWalkSource, id: uint64, n: var int) = ...
+  ## proc sum(into: var int, part: int) = into += part
+  ## let meshes = parallelWalk(initTruthWalkSource(truthApi, tempAllocatorApi, tt), [asset.u64], countMeshes, sum)
+  mixin children
+  var walk = Walk[S, R](source: source.unsafeAddr, visitor: visitor)
+  initVisitedSet(walk.visited)
+  for r in roots:
+    if walk.visited.tryVisit(r): walk.queue.ids.add r
+  walk.queue.pending = walk.queue.ids.len
+
+  let n = if workers > 0: workers else: max(1, countProcessors())
+  when compileOption("threads"):
+    if n > 1:
+      initLock(walk.queue.lock)
+      initCond(walk.queue.cond)
+      var
+        ws = newSeq[WalkWorker[S, R]](n)
+        threads = newSeq[Thread[ptr WalkWorker[S, R]]](n)
+      for i in 0 ..< n:
+        ws[i].walk = walk.addr
+        createThread(threads[i], walkWorker[S, R], ws[i].addr)
+      joinThreads(threads)
+      deinitCond(walk.queue.cond)
+      deinitLock(walk.queue.lock)
+      deinitVisitedSet(walk.visited)
+      for w in ws:
+        merge(result, w.res)
+      return
+
+  var kids: seq[uint64]
+  while walk.queue.ids.len > 0:
+    let id = walk.queue.ids.pop()
+    visitor(source, id, result)
+    kids.setLen(0)
+    children(source, id, kids)
+    for k in kids:
+      if walk.visited.tryVisit(k): walk.queue.ids.add k
+  deinitVisitedSet(walk.visited)
+
+proc parallelWalk*[S, R](source: S, root: uint64, visitor: WalkVisitor[S, R], merge: WalkMerge[R],
+    workers = 0): R {.inline.} =
+  parallelWalk(source, [root], visitor, merge, workers)
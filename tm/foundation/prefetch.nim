@@ -0,0 +1,53 @@
+# Software prefetching for loops that walk several arrays in lockstep. Doesn't depend on the
+# generated bindings, so it can also be used (and benchmarked) outside of a plugin.
+
+const CacheLineSize* = 64
+
+when defined(vcc):
+  var MM_HINT_T0 {.importc: "_MM_HINT_T0", header: "<xmmintrin.h>".}: cint
+  proc mm_prefetch(p: pointer, hint: cint) {.importc: "_mm_prefetch", header: "<xmmintrin.h>".}
+  template prefetch*(p: pointer) = mm_prefetch(p, MM_HINT_T0)
+elif defined(tcc):
+  template prefetch*(p: pointer) = discard # tcc has no prefetch builtin
+else:
+  proc builtin_prefetch(p: pointer) {.importc: "__builtin_prefetch", nodecl.}
+  template prefetch*(p: pointer) = builtin_prefetch(p)
+
+type
+  PrefetchStream = object
+    base: ptr UncheckedArray[byte]
+    stride: int
+    next: int # byte offset of the first cache line not prefetched yet
+
+  PrefetchStreams*[N: static int] = object
+    ## Up to `N` arrays of `rows` elements, each with its own stride, prefetched a cache line at a
+    ## time so a row is never prefetched twice.
+    streams: array[N, PrefetchStream]
+    len: int
+    rows: int
+
+proc initPrefetchStreams*[N: static int](rows: int): PrefetchStreams[N] {.inline.} =
+  result.rows = rows
+
+proc add*[N](s: var PrefetchStreams[N], base: pointer, stride: int) {.inline.} =
+  if base == nil or stride == 0: return
+  assert(s.len < N, "too many prefetch streams")
+  s.streams[s.len] = PrefetchStream(base: cast[ptr UncheckedArray[byte]](base), stride: stride)
+  inc s.len
+
+proc ahead*[N](s: var PrefetchStreams[N], row, distance: int) {.inline.} =
+  ## Prefetches every stream up to and including row `row + distance`.
+  let last = min(row + distance + 1, s.rows)
+  for k in 0 ..< s.len:
+    let
+      st = s.streams[k].addr
+      stop = last * st.stride
+    while st.next < stop:
+      prefetch(st.base[st.next].addr)
+      st.next += CacheLineSize
+
+iterator rows*[N](s: var PrefetchStreams[N], distance: static int = 8): int =
+  ## Yields 0 ..< rows, keeping the streams prefetched `distance` rows ahead.
+  for i in 0 ..< s.rows:
+    s.ahead(i, distance)
+    yield i
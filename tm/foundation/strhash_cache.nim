@@ -0,0 +1,156 @@
+# Interned strings and their tm_strhash_t, for names only known at runtime (tags built from strings,
+# `"color_" & $i`, ...). Interning hashes a string once and the returned InternedStr carries its
+# hash, so call sites that keep it never hash it again. Every interned or preloaded hash also maps
+# back to its string, for debug output and profiler labels. Lookups don't lock, inserts do.
+
+const strHashHeadersDir {.strdefine.} = currentSourcePath.parentDir / ".." / ".." / "headers"
+  ## Headers ``preloadSdkStrHashes`` takes the SDK's static hashes from.
+
+type
+  StrHashEntry = object
+    hash: tm_strhash_t
+    len: int
+    name: UncheckedArray[char] # `len` chars and a terminating zero
+
+  InternedStr* = distinct ptr StrHashEntry
+
+  StrHashTable = object
+    # Open addressing on the hash, at most half full. Slots are only ever filled, so readers can
+    # probe while a writer inserts; growing publishes a new table and keeps the old one for readers
+    # still probing it.
+    mask: int
+    prev: ptr StrHashTable
+    slots: UncheckedArray[Atomic[ptr StrHashEntry]]
+
+var
+  strHashes: Atomic[ptr StrHashTable]
+  strHashCount: int # under strHashLock
+when compileOption("threads"):
+  var strHashLock: Lock
+  initLock(strHashLock)
+
+template withStrHashLock(body: untyped) =
+  when compileOption("threads"):
+    withLock strHashLock:
+      body
+  else:
+    body
+
+proc findEntry(t: ptr StrHashTable, h: tm_strhash_t): ptr StrHashEntry =
+  if t == nil: return nil
+  var i = int(h.uint64) and t.mask
+  while true:
+    let e = t.slots[i].load(moAcquire)
+    if e == nil or e.hash == h: return e
+    i = (i + 1) and t.mask
+
+proc place(t: ptr StrHashTable, e: ptr StrHashEntry) =
+  var i = int(e.hash.uint64) and t.mask
+  while t.slots[i].load(moRelaxed) != nil: i = (i + 1) and t.mask
+  t.slots[i].store(e, moRelease)
+
+proc insert(e: ptr StrHashEntry) =
+  # Under strHashLock.
+  var t = strHashes.load(moRelaxed)
+  if t == nil or (strHashCount + 1) * 2 > t.mask + 1:
+    let capacity = if t == nil: 1024 else: (t.mask + 1) * 2
+    let bigger = cast[ptr StrHashTable](allocShared0(sizeof(StrHashTable) + capacity * sizeof(Atomic[ptr StrHashEntry])))
+    bigger.mask = capacity - 1
+    bigger.prev = t
+    if t != nil:
+      for i in 0 .. t.mask:
+        let old = t.slots[i].load(moRelaxed)
+        if old != nil: bigger.place(old)
+    strHashes.store(bigger, moRelease)
+    t = bigger
+  t.place(e)
+  inc strHashCount
+
+proc internHashed(s: openArray[char], h: tm_strhash_t): ptr StrHashEntry =
+  result = findEntry(strHashes.load(moAcquire), h)
+  if result != nil: return
+  withStrHashLock:
+    result = findEntry(strHashes.load(moRelaxed), h) # another thread may have inserted it
+    if result == nil:
+      result = cast[ptr StrHashEntry](allocShared0(sizeof(StrHashEntry) + s.len + 1))
+      result.hash = h
+      result.len = s.len
+      if s.len > 0: copyMem(result.name[0].addr, s[0].unsafeAddr, s.len)
+      insert(result)
+
+proc intern*(s: string): InternedStr =
+  ## Hashes `s` and records it. Strings that hash the same share the first one's entry.
+  ## Ex:
+  ## let tag = intern("color_" & $i) # once, e.g. when the system starts
+  ## tag_component_api.find_first(tag_man, tag.strhash) # every frame
+  InternedStr(internHashed(s, tm_strhash_t(murmurHash64A(s))))
+
+proc strhash*(s: InternedStr): tm_strhash_t {.inline.} =
+  (ptr StrHashEntry)(s).hash
+
+proc name*(s: InternedStr): cstring {.inline.} =
+  ## The interned string, valid until ``clearStrHashes``.
+  cast[cstring]((ptr StrHashEntry)(s).name[0].addr)
+
+proc `$`*(s: InternedStr): string =
+  $s.name
+
+proc strhash*(s: string): tm_strhash_t =
+  ## Same as TM_STATIC_HASH for strings built at runtime, and records the string for ``nameOf``.
+  ## Keep the InternedStr from ``intern`` instead where the same string is hashed repeatedly.
+  intern(s).strhash
+
+proc nameOf*(h: tm_strhash_t): cstring =
+  ## String `h` was interned or preloaded from, nil if it wasn't. Doesn't lock.
+  let e = findEntry(strHashes.load(moAcquire), h)
+  if e == nil: nil else: cast[cstring](e.name[0].addr)
+
+proc strhashLabel*(h: tm_strhash_t): string =
+  ## ``nameOf(h)``, or the hash in hex for hashes never seen, for logs and profiler scopes.
+  let name = nameOf(h)
+  if name == nil: "0x" & toHex(h.uint64).toLowerAscii else: $name
+
+proc preloadStrHashes*(names: openArray[(string, uint64)]) =
+  ## Records (name, hash) pairs known ahead of time without hashing them.
+  for (name, h) in names:
+    discard internHashed(name, tm_strhash_t(h))
+
+proc staticStrHashes*(dir: string): seq[(string, uint64)] {.compileTime.} =
+  ## (name, hash) of every `TM_STATIC_HASH("name", 0x...ULL)` in the headers under `dir`.
+  const prefix = "TM_STATIC_HASH(\""
+  for path in walkDirRec(dir):
+    if not (path.endsWith(".h") or path.endsWith(".inl")): continue
+    let text = staticRead(path)
+    var i = text.find(prefix)
+    while i >= 0:
+      let nameStart = i + prefix.len
+      let nameEnd = text.find('"', nameStart)
+      if nameEnd < 0: break
+      var p = nameEnd + 1
+      while p < text.len and text[p] in {',', ' '}: inc p
+      if text.continuesWith("0x", p):
+        var e = p + 2
+        while e < text.len and text[e] in HexDigits: inc e
+        result.add (text[nameStart ..< nameEnd], fromHex[uint64](text[p + 2 ..< e]))
+      i = text.find(prefix, nameEnd)
+
+template preloadSdkStrHashes*() =
+  ## Records the names of the static hashes in the SDK headers (type names, interfaces, ...), so
+  ## ``nameOf`` resolves them. Set `-d:strHashHeadersDir=<dir>` if the headers are elsewhere.
+  preloadStrHashes(static(staticStrHashes(strHashHeadersDir)))
+
+proc clearStrHashes*() =
+  ## Frees every interned string, e.g. on plugin unload. InternedStr and ``nameOf`` results die
+  ## with them, so nothing may use them or intern concurrently.
+  withStrHashLock:
+    var t = strHashes.load(moRelaxed)
+    if t != nil:
+      for i in 0 .. t.mask:
+        let e = t.slots[i].load(moRelaxed)
+        if e != nil: deallocShared(e)
+    while t != nil:
+      let prev = t.prev
+      deallocShared(t)
+      t = prev
+    strHashes.store(nil, moRelease)
+    strHashCount = 0
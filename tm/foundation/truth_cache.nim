@@ -0,0 +1,98 @@
+type
+  TruthCacheBuild*[T] = proc (tt: ptr tm_the_truth_o, id: tm_tt_id_t, entry: var T)
+
+  TruthCacheEntry[T] = object
+    version: uint32 # version() of the object when `value` was built
+    value: T
+
+  TruthCache*[T] = object
+    ## Runtime data derived from the Truth objects of one type, kept up to date from the changelog.
+    ## Each ``update`` only rebuilds the objects returned by ``changed_objects``, and falls back to
+    ## rebuilding everything when the changelog overflowed (more than 512 changes since the last
+    ## update).
+    ## Ex:
+    ## var curves = initTruthCache[BakedCurve](truthApi, tempAllocatorApi, tt, TM_TT_TYPE_HASH_CURVE,
+    ##   proc (tt: ptr tm_the_truth_o, id: tm_tt_id_t, c: var BakedCurve) = c = bake(tt, id))
+    ## ...
+    ## curves.update()
+    ## let c = curves.get(id)
+    api: ptr tm_the_truth_api
+    taApi: ptr tm_temp_allocator_api
+    tt: ptr tm_the_truth_o
+    objectType: tm_tt_type_t
+    changelog: uint64 # request_changelog() handle
+    sinceVersion: uint64
+    build: TruthCacheBuild[T]
+    entries: Table[uint64, TruthCacheEntry[T]]
+    resyncs*, rebuilds*: int # stats, since creation
+
+proc initTruthCache*[T](api: ptr tm_the_truth_api, taApi: ptr tm_temp_allocator_api, tt: ptr tm_the_truth_o,
+    typeHash: tm_strhash_t, build: TruthCacheBuild[T]): TruthCache[T] =
+  ## Requests the changelog for `tt`. Call ``close`` to relinquish it. The cache is filled on the
+  ## first ``update``.
+  TruthCache[T](api: api, taApi: taApi, tt: tt, objectType: api.object_type_from_name_hash(tt, typeHash),
+    changelog: api.request_changelog(tt), sinceVersion: high(uint64), build: build)
+
+proc close*[T](c: var TruthCache[T]) =
+  if c.tt != nil:
+    c.api.relinquish_changelog(c.tt, c.changelog)
+  c.entries.clear()
+  c.tt = nil
+
+proc refresh[T](c: var TruthCache[T], id: tm_tt_id_t): bool =
+  # Rebuilds the entry of `id` if its version moved. Objects that were destroyed are dropped.
+  let v = c.api.version(c.tt, id)
+  if v == 0:
+    c.entries.del(id.u64)
+    return false
+  c.entries.withValue(id.u64, e):
+    if e.version == v: return false
+    e.version = v
+    c.build(c.tt, id, e.value)
+  do:
+    var e = TruthCacheEntry[T](version: v)
+    c.build(c.tt, id, e.value)
+    c.entries[id.u64] = move e
+  inc c.rebuilds
+  true
+
+proc resync[T](c: var TruthCache[T], ta: ptr tm_temp_allocator_i): int =
+  let all = c.api.all_objects_of_type(c.tt, c.objectType, ta)
+  var alive = initHashSet[uint64](tm_carray_size(all).int)
+  for id in carray_items(all):
+    alive.incl id.u64
+    if c.refresh(id): inc result
+  var dead: seq[uint64]
+  for k in c.entries.keys:
+    if k notin alive: dead.add k
+  for k in dead:
+    c.entries.del(k)
+  inc c.resyncs
+
+proc update*[T](c: var TruthCache[T]): int {.discardable.} =
+  ## Pulls the changes since the last call and rebuilds the affected entries. Returns the number
+  ## of entries rebuilt. Objects changed several times are rebuilt once, since the cached version
+  ## is compared before building.
+  var ta = c.taApi.init()
+  let changes = c.api.changed_objects(c.tt, c.objectType, c.sinceVersion, ta)
+  c.sinceVersion = changes.version
+  if changes.overflow:
+    return c.resync(ta)
+  for id in items(changes.objects, changes.num_objects):
+    if c.refresh(id): inc result
+
+proc len*[T](c: TruthCache[T]): int {.inline.} =
+  c.entries.len
+
+proc contains*[T](c: TruthCache[T], id: tm_tt_id_t): bool {.inline.} =
+  id.u64 in c.entries
+
+proc get*[T](c: var TruthCache[T], id: tm_tt_id_t): ptr T =
+  ## The cached value for `id`, or nil if `id` isn't in the cache. Only valid until the next
+  ## ``update``.
+  c.entries.withValue(id.u64, e):
+    return e.value.addr
+
+iterator pairs*[T](c: var TruthCache[T]): (tm_tt_id_t, ptr T) =
+  for k, e in c.entries.mpairs:
+    yield (tm_tt_id_t(u64: k), e.value.addr)
@@ -0,0 +1,278 @@
+type
+  TruthMemorySet = object
+    # Layout of `tm_set_t` (`TM_SET_T(uint64_t)` in hash.inl), which the bindings only see as an
+    # opaque forward declaration.
+    num_buckets, num_used: uint32
+    temp: int32
+    padding: uint32
+    keys: ptr uint64
+    allocator: ptr tm_allocator_i
+
+  MemoryUseRow* = object
+    name*: string # type name, or asset path
+    objects*: int
+    propertyBytes*: uint64 # resident bytes that aren't buffers: properties, strings, bookkeeping
+    bufferBytes*: uint64 # resident buffer bytes, each buffer counted once per report
+    unloadedBytes*: uint64 # buffer bytes that can be streamed in on request
+
+  TruthMemoryReport* = object
+    ## Sorted by ``total`` bytes, largest first.
+    byType*, byAsset*: seq[MemoryUseRow]
+
+  ProfilerPhase = enum
+    ppObjects # visiting the objects of each type
+    ppAssets  # memory_use() of each asset with the shared dedupe set
+
+  TruthMemoryProfiler* = object
+    ## Estimates how much memory each type and each asset of a Truth uses, spread over several
+    ## frames. Each ``step`` makes about `budget` ``memory_use`` calls: one per object and one per
+    ## direct subobject, or one per asset in the final phase. A call walks the whole subtree of its
+    ## object, so a step over large assets costs more than one over leaf objects, and an object
+    ## with more subobjects than `budget` is still done in one step. When a pass over the whole
+    ## Truth is done the result is available in ``report``, and the next ``step`` starts a new pass.
+    ## Objects belong to the nearest owner of the asset type (`assetTypeHash`), or to their root
+    ## owner if the Truth has no such type. Asset paths are built from the asset's `name` and the
+    ## `name`/`parent` chain of its `directory`, when these properties exist.
+    ## Ex:
+    ## var profiler = initTruthMemoryProfiler(truthApi, tempAllocatorApi, tt)
+    ## ... every frame:
+    ## if profiler.step():
+    ##   profiler.report.writeCsv("memory_by_asset.csv", "memory_by_type.csv")
+    api: ptr tm_the_truth_api
+    taApi: ptr tm_temp_allocator_api
+    tt: ptr tm_the_truth_o
+    assetTypeHash: tm_strhash_t
+    budget*: int
+    phase: ProfilerPhase
+    assetType: tm_tt_type_t
+    nextType: uint64 # type whose objects are fetched next
+    objects: seq[tm_tt_id_t] # objects of the current type
+    cursor: int # next index into `objects` (or `assets` in ppAssets)
+    seenBuffers: HashSet[uint32] # buffers already counted in this pass
+    assetOf: Table[uint64, uint64] # object -> asset, memoizes the owner walk
+    byType: Table[uint64, MemoryUseRow]
+    byAsset: Table[uint64, MemoryUseRow]
+    assets: seq[uint64] # keys of `byAsset`, for ppAssets
+    shared: TruthMemorySet # dedupe set passed to memory_use() in ppAssets
+    passes*: int
+    report*: TruthMemoryReport # last completed pass
+
+proc total*(r: MemoryUseRow): uint64 {.inline.} =
+  r.propertyBytes + r.bufferBytes
+
+proc initTruthMemoryProfiler*(api: ptr tm_the_truth_api, taApi: ptr tm_temp_allocator_api, tt: ptr tm_the_truth_o,
+    budget = 2000, assetTypeHash = TM_STATIC_HASH("tm_asset")): TruthMemoryProfiler =
+  ## `budget` is the number of ``memory_use`` calls per ``step``.
+  TruthMemoryProfiler(api: api, taApi: taApi, tt: tt, budget: budget, assetTypeHash: assetTypeHash, nextType: 1)
+
+proc freeShared(p: var TruthMemoryProfiler) =
+  # tm_set_free()
+  let s = p.shared.addr
+  if s.allocator != nil and s.keys != nil:
+    discard s.allocator.realloc(s.allocator, s.keys, s.num_buckets.uint64 * sizeu64(uint64), 0, "truth_memory_profiler.nim", 0)
+  p.shared = TruthMemorySet()
+
+proc propertyOf(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, o: tm_tt_id_t, name: static string): int {.inline.} =
+  propIndex(api, tt, o.to_tt_type, name)
+
+proc assetPath(p: TruthMemoryProfiler, asset: tm_tt_id_t): string =
+  # "dir/sub/name" from the asset's `name` and its `directory` chain, or "<type> <id>".
+  let api = p.api
+  var
+    o = asset
+    depth = 0
+    parts: seq[string]
+  while o.u64 != 0 and depth < 64:
+    let r = api.read(p.tt, o)
+    if r == nil: break
+    let name = api.propertyOf(p.tt, o, "name")
+    if name < 0: break
+    let s = api.get_string(p.tt, r, name.uint32)
+    if s != nil and s[0] != '\0': parts.add $s
+    let next = if depth == 0: api.propertyOf(p.tt, o, "directory") else: api.propertyOf(p.tt, o, "parent")
+    o = if next >= 0: api.get_reference(p.tt, r, next.uint32) else: tm_tt_id_t(u64: 0)
+    inc depth
+  if parts.len == 0:
+    return &"{api.type_name(p.tt, asset.to_tt_type)} {asset.u64:#x}"
+  for i in countdown(parts.high, 0):
+    result.add parts[i]
+    if i > 0: result.add '/'
+
+proc findAsset(p: var TruthMemoryProfiler, o: tm_tt_id_t): uint64 =
+  # Nearest owner (or `o` itself) of the asset type, otherwise the root owner.
+  var
+    chain: seq[uint64]
+    cur = o
+  while true:
+    p.assetOf.withValue(cur.u64, a):
+      result = a[]
+    if result != 0: break
+    chain.add cur.u64
+    if p.assetType.u64 != 0 and cur.to_tt_type.u64 == p.assetType.u64:
+      result = cur.u64
+      break
+    let owner = p.api.owner(p.tt, cur)
+    if owner.u64 == 0:
+      result = cur.u64
+      break
+    cur = owner
+  for c in chain:
+    p.assetOf[c] = result
+
+proc profileObject(p: var TruthMemoryProfiler, o: tm_tt_id_t, kids: var seq[uint64]): int =
+  # Self bytes are the inclusive memory_use() minus that of the direct subobjects. Returns the
+  # number of memory_use() calls.
+  let
+    api = p.api
+    r = api.read(p.tt, o)
+  if r == nil: return 1
+  let t = o.to_tt_type
+  var self = api.memory_use(p.tt, o, nil)
+  kids.setLen(0)
+  children(initTruthWalkSource(api, p.taApi, p.tt, followReferences = false), o.u64, kids)
+  result = 1 + kids.len
+  for k in kids:
+    let sub = api.memory_use(p.tt, tm_tt_id_t(u64: k), nil)
+    self.resident -= min(self.resident, sub.resident)
+    self.unloaded -= min(self.unloaded, sub.unloaded)
+
+  var own, counted: uint64 # own buffers; those not already counted in this pass
+  let
+    buffers = api.buffers(p.tt)
+    streamable = api.streamable_buffers(p.tt) # residency; tm_buffers_i has no is_loaded
+    props = api.properties(p.tt, t)
+  for i, d in pairs(props, api.num_properties(p.tt, t)):
+    if d.`type` != TM_THE_TRUTH_PROPERTY_TYPE_BUFFER: continue
+    let id = api.get_buffer_id(p.tt, r, i.uint32)
+    if id == 0 or not streamable.is_loaded(streamable.inst, id): continue
+    let size = buffers.size(buffers.inst, id)
+    own += size
+    if not p.seenBuffers.containsOrIncl(id): counted += size
+
+  let propertyBytes = self.resident - min(self.resident, own)
+  template account(row: var MemoryUseRow) =
+    inc row.objects
+    row.propertyBytes += propertyBytes
+    row.bufferBytes += counted
+  p.byType.mgetOrPut(t.u64, MemoryUseRow(name: $api.type_name(p.tt, t))).account()
+  let asset = p.findAsset(o)
+  p.byAsset.withValue(asset, row):
+    row[].account()
+  do:
+    var row = MemoryUseRow(name: p.assetPath(tm_tt_id_t(u64: asset)))
+    row.account()
+    p.byAsset[asset] = row
+
+proc sortedRows(t: Table[uint64, MemoryUseRow]): seq[MemoryUseRow] =
+  for row in t.values: result.add row
+  result.sort(proc (a, b: MemoryUseRow): int = cmp(b.total, a.total))
+
+proc restart(p: var TruthMemoryProfiler) =
+  p.freeShared()
+  p.objects.setLen(0)
+  p.seenBuffers.clear()
+  p.assetOf.clear()
+  p.byType.clear()
+  p.byAsset.clear()
+  p.assets.setLen(0)
+  p.phase = ppObjects
+  p.nextType = 1
+  p.cursor = 0
+
+proc close*(p: var TruthMemoryProfiler) =
+  ## Abandons the current pass and frees its dedupe set. ``report`` stays valid.
+  p.restart()
+
+proc step*(p: var TruthMemoryProfiler): bool {.discardable.} =
+  ## Profiles objects until about `budget` ``memory_use`` calls were made. Returns *true* when
+  ## this call completed a pass and ``report`` was updated.
+  let api = p.api
+  var
+    left = p.budget
+    kids: seq[uint64]
+  while left > 0:
+    case p.phase:
+      of ppObjects:
+        if p.cursor < p.objects.len:
+          left -= p.profileObject(p.objects[p.cursor], kids)
+          inc p.cursor
+          continue
+        # Objects created during the pass are picked up by the next one.
+        if p.nextType >= api.num_types(p.tt).uint64:
+          p.objects.setLen(0)
+          p.assets = toSeq(p.byAsset.keys)
+          p.shared.allocator = api.allocator(p.tt)
+          p.cursor = 0
+          p.phase = ppAssets
+          continue
+        if p.nextType == 1:
+          p.assetType = api.object_type_from_name_hash(p.tt, p.assetTypeHash)
+        var ta = p.taApi.init()
+        let all = api.all_objects_of_type(p.tt, tm_tt_type_t(u64: p.nextType), ta)
+        p.objects.setLen(0)
+        for o in carray_items(all): p.objects.add o
+        p.cursor = 0
+        inc p.nextType
+      of ppAssets:
+        if p.cursor >= p.assets.len:
+          p.report = TruthMemoryReport(byType: sortedRows(p.byType), byAsset: sortedRows(p.byAsset))
+          inc p.passes
+          p.restart()
+          return true
+        # The shared set only counts strings and buffers that several assets use for the first
+        # of them, so the deduped resident bytes are the asset's share of the total.
+        let
+          a = p.assets[p.cursor]
+          use = api.memory_use(p.tt, tm_tt_id_t(u64: a), cast[ptr tm_set_t](p.shared.addr))
+        p.byAsset.withValue(a, row):
+          row.unloadedBytes = use.unloaded
+          let deduped = use.resident - min(use.resident, row.bufferBytes)
+          row.propertyBytes = min(row.propertyBytes, deduped)
+        inc p.cursor
+        dec left
+
+proc csvField(s: string): string =
+  if s.find({',', '"', '\n'}) < 0: return s
+  result = "\""
+  for c in s:
+    if c == '"': result.add '"'
+    result.add c
+  result.add '"'
+
+proc jsonString(s: string): string =
+  result = "\""
+  for c in s:
+    case c:
+      of '"': result.add "\\\""
+      of '\\': result.add "\\\\"
+      of '\n': result.add "\\n"
+      of '\0'..'\9', '\11'..'\31': result.add &"\\u{c.int:04x}"
+      else: result.add c
+  result.add '"'
+
+proc toCsv*(rows: openArray[MemoryUseRow]): string =
+  result = "name,objects,property_bytes,buffer_bytes,unloaded_bytes,total_bytes\n"
+  for r in rows:
+    result.add &"{csvField(r.name)},{r.objects},{r.propertyBytes},{r.bufferBytes},{r.unloadedBytes},{r.total}\n"
+
+proc toJson*(report: TruthMemoryReport): string =
+  ## `{"by_type": [...], "by_asset": [...]}` with one object per row.
+  proc rows(s: var string, rows: openArray[MemoryUseRow]) =
+    s.add '['
+    for i, r in rows:
+      if i > 0: s.add ','
+      s.add &"\n    {{\"name\": {jsonString(r.name)}, \"objects\": {r.objects}, \"property_bytes\": {r.propertyBytes}, "
+      s.add &"\"buffer_bytes\": {r.bufferBytes}, \"unloaded_bytes\": {r.unloadedBytes}, \"total_bytes\": {r.total}}}"
+    s.add "\n  ]"
+  result = "{\n  \"by_type\": "
+  result.rows(report.byType)
+  result.add ",\n  \"by_asset\": "
+  result.rows(report.byAsset)
+  result.add "\n}\n"
+
+proc writeCsv*(report: TruthMemoryReport, assetsPath, typesPath: string) =
+  writeFile(assetsPath, report.byAsset.toCsv)
+  writeFile(typesPath, report.byType.toCsv)
+
+proc writeJson*(report: TruthMemoryReport, path: string) =
+  writeFile(path, report.toJson)
@@ -0,0 +1,219 @@
+type
+  TruthField = object
+    name, T, default, typeHash: NimNode
+    propType, getter, setter: string
+    subobject: bool
+
+proc accessors(f: var TruthField, propType, getter, setter: string) =
+  f.propType = propType
+  f.getter = getter
+  f.setter = setter
+
+proc truthFieldKind(f: var TruthField) =
+  let T = f.T
+  if T.eqIdent("bool"):
+    f.accessors("TM_THE_TRUTH_PROPERTY_TYPE_BOOL", "get_bool", "set_bool")
+  elif T.eqIdent("uint32"):
+    f.accessors("TM_THE_TRUTH_PROPERTY_TYPE_UINT32_T", "get_uint32_t", "set_uint32_t")
+  elif T.eqIdent("uint64"):
+    f.accessors("TM_THE_TRUTH_PROPERTY_TYPE_UINT64_T", "get_uint64_t", "set_uint64_t")
+  elif T.eqIdent("float32") or T.eqIdent("cfloat"):
+    f.accessors("TM_THE_TRUTH_PROPERTY_TYPE_FLOAT", "get_float", "set_float")
+  elif T.eqIdent("float") or T.eqIdent("float64") or T.eqIdent("cdouble"):
+    f.accessors("TM_THE_TRUTH_PROPERTY_TYPE_DOUBLE", "get_double", "set_double")
+  elif T.eqIdent("string"):
+    f.accessors("TM_THE_TRUTH_PROPERTY_TYPE_STRING", "get_string", "set_string")
+  elif T.eqIdent("tm_tt_id_t"):
+    if f.subobject:
+      f.accessors("TM_THE_TRUTH_PROPERTY_TYPE_SUBOBJECT", "get_subobject", "set_subobject_id")
+    else:
+      f.accessors("TM_THE_TRUTH_PROPERTY_TYPE_REFERENCE", "get_reference", "set_reference")
+  else:
+    error(&"unsupported Truth property type: {T.repr}", T)
+
+proc parseTruthField(n: NimNode): TruthField =
+  # frequency: float32 = 2.0
+  # child {.subobject: TM_TT_TYPE_HASH_X.}: tm_tt_id_t
+  if n.kind != nnkCall or n.len != 2 or n[1].kind != nnkStmtList:
+    error(&"expected `field: type [= default]`, got: {n.repr}", n)
+  var name = n[0]
+  if name.kind == nnkPragmaExpr:
+    for p in name[1]:
+      var (key, val) = (p, NimNode(nil))
+      if p.kind == nnkExprColonExpr:
+        (key, val) = (p[0], p[1])
+      if key.eqIdent("subobject"):
+        result.subobject = true
+        result.typeHash = val
+      elif key.eqIdent("reference"):
+        result.typeHash = val
+      else:
+        error(&"unknown Truth property pragma: {key.repr}", p)
+    name = name[0]
+  result.name = name
+  let t = n[1][0]
+  if t.kind == nnkAsgn:
+    result.T = t[0]
+    result.default = t[1]
+  else:
+    result.T = t
+  truthFieldKind(result)
+
+macro truthObject*(name: untyped, body: untyped): untyped =
+  ## Declares a Nim object mirroring a Truth type and generates from it:
+  ## - ``<name>Prop``, an enum of the property indices (capitalized field names),
+  ## - ``truthProperties(T)``, the property definitions for ``create_object_type``,
+  ## - ``createObjectType(api, tt, T, "type_name")``, which also sets the default object if any
+  ##   field has a default,
+  ## - ``T.read(api, tt, id)`` reading every property from a single ``read()``,
+  ## - ``v.write(api, tt, id, undo)`` setting every property under one ``write``/``commit``, and
+  ##   batched overloads over ``openArray``s of IDs committing with one ``commit_range``.
+  ##
+  ## Supported field types are bool, uint32, uint64, float32, float (double), string and
+  ## tm_tt_id_t (a reference, or a subobject with the ``{.subobject.}`` pragma). Reference and
+  ## subobject fields take the allowed type hash as the pragma argument.
+  ## Ex:
+  ## truthObject CustomComponentAsset:
+  ##   frequency: float32 = 2.0
+  ##   amplitude: float32 = 1.0
+  ##   target {.reference: TM_TT_TYPE_HASH_ENTITY.}: tm_tt_id_t
+  ##
+  ## discard truthApi.createObjectType(tt, CustomComponentAsset, "custom_component")
+  ## let c = CustomComponentAsset.read(truthApi, tt, compAsset)
+  var fields: seq[TruthField]
+  for n in body:
+    if n.kind == nnkCommentStmt: continue
+    fields.add parseTruthField(n)
+  let count = fields.len
+  if count == 0: error("truthObject needs at least one field", body)
+
+  let
+    propEnum = ident($name & "Prop")
+    api = ident("api")
+    tt = ident("tt")
+    obj = ident("obj")
+    v = ident("v")
+    undo = ident("undo")
+  var
+    recList = newNimNode(nnkRecList)
+    enumTy = nnkEnumTy.newTree(newEmptyNode())
+    defs = newNimNode(nnkBracket)
+    defaults = nnkObjConstr.newTree(name)
+    reads = newStmtList()
+    writes = newStmtList()
+  for i, f in fields:
+    recList.add newIdentDefs(postfix(f.name, "*"), f.T)
+    var enumName = $f.name
+    if enumName[0] in 'a'..'z': enumName[0] = chr(ord(enumName[0]) - ord('a') + ord('A'))
+    enumTy.add ident(enumName)
+
+    var def = nnkObjConstr.newTree(ident("tm_the_truth_property_definition_t"),
+      nnkExprColonExpr.newTree(ident("name"), newLit($f.name)),
+      nnkExprColonExpr.newTree(nnkAccQuoted.newTree(ident("type")), ident(f.propType)))
+    if f.typeHash != nil:
+      def.add nnkExprColonExpr.newTree(ident("type_hash"), f.typeHash)
+    defs.add def
+    if f.default != nil:
+      defaults.add nnkExprColonExpr.newTree(f.name, f.default)
+
+    let
+      field = f.name
+      getter = ident(f.getter)
+      setter = ident(f.setter)
+      prop = newLit(uint32(i))
+    if f.T.eqIdent("string"):
+      reads.add genAst(api, tt, obj, v, field, getter, prop) do:
+        v.field = $api.getter(tt, obj, prop)
+      writes.add genAst(api, tt, obj, v, field, setter, prop) do:
+        api.setter(tt, obj, prop, v.field.cstring)
+    else:
+      reads.add genAst(api, tt, obj, v, field, getter, prop) do:
+        v.field = api.getter(tt, obj, prop)
+      if f.subobject:
+        writes.add genAst(api, tt, obj, v, field, setter, prop, undo) do:
+          api.setter(tt, obj, prop, v.field, undo)
+      else:
+        writes.add genAst(api, tt, obj, v, field, setter, prop) do:
+          api.setter(tt, obj, prop, v.field)
+
+  let typeDef = nnkTypeSection.newTree(
+    nnkTypeDef.newTree(postfix(name, "*"), newEmptyNode(), nnkObjectTy.newTree(newEmptyNode(), newEmptyNode(), recList)),
+    nnkTypeDef.newTree(postfix(propEnum, "*"), newEmptyNode(), enumTy))
+  let hasDefaults = newLit(defaults.len > 1)
+
+  let procs = genAst(name, api, tt, obj, v, undo, defs, defaults, reads, writes, count, hasDefaults):
+    proc truthProperties*(_: typedesc[name]): array[count, tm_the_truth_property_definition_t] =
+      defs
+
+    proc truthDefault*(_: typedesc[name]): name =
+      defaults
+
+    proc readProperties*(v: var name, api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, obj: ptr tm_the_truth_object_o) =
+      reads
+
+    proc writeProperties*(v: name, api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, obj: ptr tm_the_truth_object_o,
+        undo: tm_tt_undo_scope_t) =
+      writes
+
+    proc read*(_: typedesc[name], api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, id: tm_tt_id_t): name =
+      ## Reads every property of `id`. Returns the zero value if `id` isn't alive.
+      let obj = api.read(tt, id)
+      if obj != nil:
+        result.readProperties(api, tt, obj)
+
+    proc read*(_: typedesc[name], api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, ids: openArray[tm_tt_id_t]): seq[name] =
+      result = newSeq[name](ids.len)
+      for i, id in ids:
+        let obj = api.read(tt, id)
+        if obj != nil:
+          result[i].readProperties(api, tt, obj)
+
+    proc write*(v: name, api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, id: tm_tt_id_t,
+        undo = TM_TT_NO_UNDO_SCOPE) =
+      let obj = api.write(tt, id)
+      v.writeProperties(api, tt, obj, undo)
+      api.commit(tt, obj, undo)
+
+    proc write*(values: openArray[name], api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, ids: openArray[tm_tt_id_t],
+        undo = TM_TT_NO_UNDO_SCOPE) =
+      ## Writes `values[i]` to `ids[i]` and commits them all with one ``commit_range``.
+      assert(values.len == ids.len, "values and ids differ in length")
+      if ids.len == 0: return
+      var objs = newSeq[ptr tm_the_truth_object_o](ids.len)
+      for i, id in ids:
+        objs[i] = api.write(tt, id)
+        values[i].writeProperties(api, tt, objs[i], undo)
+      api.commit_range(tt, objs[0].addr, objs.len.uint32, undo)
+
+    proc createObjectType*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, _: typedesc[name], typeName: cstring): tm_tt_type_t =
+      ## ``create_object_type`` with the generated property definitions. Sets a default object
+      ## holding the field defaults if any were declared.
+      var props = truthProperties(name)
+      result = api.create_object_type(tt, typeName, props[0].addr, props.len.uint32)
+      when hasDefaults:
+        let d = api.create_object_of_type(tt, result, TM_TT_NO_UNDO_SCOPE)
+        truthDefault(name).write(api, tt, d)
+        api.set_default_object(tt, result, d)
+
+  result = newStmtList(typeDef, procs)
+
+proc createObjects*[T](values: openArray[T], api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, typeHash: tm_strhash_t,
+    undoName = "", disableChangelog = false): tuple[ids: seq[tm_tt_id_t], undo: tm_tt_undo_scope_t] =
+  ## Creates one object of type `typeHash` per value (a ``truthObject`` type), sets all their
+  ## properties and commits them with a single ``commit_range``, instead of one write/commit per
+  ## object like ``quick_create_object``. Everything is recorded under one undo scope named
+  ## `undoName`, or isn't undoable if `undoName` is empty. `disableChangelog` suspends the
+  ## changelog while creating, for importers that don't need other systems to see the changes.
+  ## Ex:
+  ## let (ids, undo) = records.createObjects(truthApi, tt, TM_TT_TYPE_HASH_MY_RECORD, "Import records")
+  mixin write
+  let objectType = api.object_type_from_name_hash(tt, typeHash)
+  result.undo = if undoName.len > 0: api.create_undo_scope(tt, undoName) else: TM_TT_NO_UNDO_SCOPE
+  if disableChangelog: api.disable_changelog_start_scope(tt)
+  defer:
+    if disableChangelog: api.disable_changelog_end_scope(tt)
+
+  result.ids = newSeq[tm_tt_id_t](values.len)
+  for id in result.ids.mitems:
+    id = api.create_object_of_type(tt, objectType, result.undo)
+  values.write(api, tt, result.ids, result.undo)
@@ -0,0 +1,130 @@
+type
+  TruthPathStepKind* = enum
+    tpSubobject  # follow a subobject property
+    tpReference  # follow a reference property
+    tpSetIndex   # take the n-th member of a subobject set
+    tpSetOfType  # take the first member of a subobject set with a given type
+
+  TruthPathStep* = object
+    kind*: TruthPathStepKind
+    property*: uint32
+    index*: uint32 # tpSetIndex
+    typeHash*: tm_strhash_t # tpSetOfType
+
+  TruthPathMemo[T] = object
+    version: uint32 # version() of the root object when `value` was read
+    value: T
+
+  TruthPath*[T] = object
+    ## A property lookup through subobjects, resolved with direct ``read``/``get_subobject`` calls
+    ## instead of the variadic ``quick_get_property``. Values are memoized per root object and
+    ## reused while the root's ``version()`` doesn't change (the version covers subobjects, so
+    ## paths that follow references aren't memoized). Neither are values read through an object
+    ## with a prototype, they change with the prototype without the root's version changing. At
+    ## most ``TruthPathMemoLimit`` roots are remembered.
+    ## Ex:
+    ## var localY = truthPath(float32, [
+    ##   viaSetOfType(TM_TT_PROP_ENTITY_COMPONENTS, TM_TT_TYPE_HASH_TRANSFORM_COMPONENT),
+    ##   viaSubobject(TM_TT_PROP_TRANSFORM_COMPONENT_LOCAL_POSITION)],
+    ##   TM_TT_PROP_POSITION_Y)
+    ## let y = localY.get(truthApi, tt, ownerAsset)
+    steps: seq[TruthPathStep]
+    property: uint32
+    memoize: bool
+    tt: ptr tm_the_truth_o # truth that `types` and `memo` belong to
+    types: seq[tm_tt_type_t] # resolved type of each tpSetOfType step
+    memo: Table[uint64, TruthPathMemo[T]]
+
+const TruthPathMemoLimit* = 4096 # memoized roots per path, the memo is cleared when it's full
+
+proc viaSubobject*(property: Ordinal): TruthPathStep =
+  TruthPathStep(kind: tpSubobject, property: uint32(ord(property)))
+
+proc viaReference*(property: Ordinal): TruthPathStep =
+  TruthPathStep(kind: tpReference, property: uint32(ord(property)))
+
+proc viaSetIndex*(property: Ordinal, index: int): TruthPathStep =
+  TruthPathStep(kind: tpSetIndex, property: uint32(ord(property)), index: uint32(index))
+
+proc viaSetOfType*(property: Ordinal, typeHash: tm_strhash_t): TruthPathStep =
+  TruthPathStep(kind: tpSetOfType, property: uint32(ord(property)), typeHash: typeHash)
+
+proc validateTruthPath(steps: openArray[TruthPathStep], property: int) =
+  doAssert steps.len <= 16, "Truth path is too deep"
+  doAssert property >= 0, "Truth path must end with a property index"
+  for s in steps:
+    if s.kind == tpSetOfType:
+      doAssert s.typeHash.uint64 != 0, "viaSetOfType needs a type hash"
+
+proc initTruthPath*[T](steps: openArray[TruthPathStep], property: uint32): TruthPath[T] =
+  result = TruthPath[T](steps: @steps, property: property, memoize: true)
+  for s in steps:
+    if s.kind == tpReference: result.memoize = false
+  result.types.setLen(steps.len)
+
+template truthPath*(T: typedesc, steps, property: untyped): TruthPath[T] =
+  ## Builds a path from constant steps; the steps are checked at compile time.
+  static: validateTruthPath(steps, ord(property))
+  initTruthPath[T](steps, uint32(ord(property)))
+
+proc getValue[T](api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, r: ptr tm_the_truth_object_o, property: uint32): T {.inline.} =
+  when T is bool: api.get_bool(tt, r, property)
+  elif T is uint32: api.get_uint32_t(tt, r, property)
+  elif T is uint64: api.get_uint64_t(tt, r, property)
+  elif T is float32: api.get_float(tt, r, property)
+  elif T is float64: api.get_double(tt, r, property)
+  elif T is cstring: api.get_string(tt, r, property)
+  elif T is tm_tt_id_t: api.get_subobject(tt, r, property)
+  else: {.error: "unsupported TruthPath value type: " & $T.}
+
+proc resolve[T](p: var TruthPath[T], api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, root: tm_tt_id_t,
+    taApi: ptr tm_temp_allocator_api, inherits: var bool): tm_tt_id_t =
+  # `inherits` is set if an object along the path, the result included, has a prototype.
+  if p.tt != tt:
+    p.tt = tt
+    p.memo.clear()
+    for t in p.types.mitems: t = tm_tt_type_t(u64: 0)
+  result = root
+  for i, s in p.steps:
+    if result.u64 == 0: return
+    if api.prototype(tt, result).u64 != 0: inherits = true
+    let r = api.read(tt, result)
+    if r == nil: return tm_tt_id_t(u64: 0)
+    case s.kind:
+      of tpSubobject: result = api.get_subobject(tt, r, s.property)
+      of tpReference: result = api.get_reference(tt, r, s.property)
+      of tpSetOfType:
+        if p.types[i].u64 == 0:
+          p.types[i] = api.object_type_from_name_hash(tt, s.typeHash)
+        result = api.find_subobject_of_type(tt, r, s.property, p.types[i])
+      of tpSetIndex:
+        assert(taApi != nil, "viaSetIndex needs a temp allocator api")
+        var ta = taApi.init()
+        let members = api.get_subobject_set(tt, r, s.property, ta)
+        result = if s.index.uint64 < tm_carray_size(members): members[s.index.int] else: tm_tt_id_t(u64: 0)
+  if result.u64 != 0 and api.prototype(tt, result).u64 != 0: inherits = true
+
+proc resolve*[T](p: var TruthPath[T], api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, root: tm_tt_id_t,
+    taApi: ptr tm_temp_allocator_api = nil): tm_tt_id_t =
+  ## Returns the object holding the final property, or a nil ID if the path is broken. `taApi` is
+  ## only needed for ``viaSetIndex`` steps.
+  var inherits = false
+  p.resolve(api, tt, root, taApi, inherits)
+
+proc get*[T](p: var TruthPath[T], api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, root: tm_tt_id_t,
+    taApi: ptr tm_temp_allocator_api = nil): T =
+  ## Reads the value at the end of the path from `root`. Returns the zero value if the path is
+  ## broken.
+  let version = if p.memoize: api.version(tt, root) else: 0
+  if p.memoize and p.tt == tt:
+    p.memo.withValue(root.u64, m):
+      if m.version == version: return m.value
+  var inherits = false
+  let leaf = p.resolve(api, tt, root, taApi, inherits)
+  if leaf.u64 != 0:
+    let r = api.read(tt, leaf)
+    if r != nil:
+      result = getValue[T](api, tt, r, p.property)
+  if p.memoize and version != 0 and not inherits:
+    if p.memo.len >= TruthPathMemoLimit and root.u64 notin p.memo: p.memo.clear()
+    p.memo[root.u64] = TruthPathMemo[T](version: version, value: result)
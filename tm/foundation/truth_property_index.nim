@@ -0,0 +1,110 @@
+type
+  PropertyIndexSlot = object
+    objectType: uint64 # 0 marks an empty slot, type 0 is never a valid object type
+    nameHash: tm_strhash_t
+    index: int32 # -1 if the type doesn't have the property
+    numProperties: uint32 # of the type when cached, the engine adds properties behind our back
+
+  PropertyIndexCache = object
+    # Flat open-addressing table of (type, name hash) -> property, for one Truth.
+    tt: ptr tm_the_truth_o
+    generation: uint32
+    slots: seq[PropertyIndexSlot]
+    count: int
+
+var
+  # One per Truth seen, there are only ever a few. Not locked: look properties up from one thread,
+  # or give other threads their own indices up front.
+  propertyIndexCaches: seq[PropertyIndexCache]
+  propertyIndexGeneration = 1'u32
+
+proc invalidatePropertyIndices*() {.inline.} =
+  ## Drops every cached property index. ``addProperties`` and ``hotReload`` call this; call it
+  ## yourself after a hot reload the wrapper didn't see or when a Truth is destroyed. Properties
+  ## the engine adds itself are noticed by their count.
+  inc propertyIndexGeneration
+
+proc addProperties*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, objectType: tm_tt_type_t,
+    properties: openArray[tm_the_truth_property_definition_t]) =
+  ## Wraps ``add_properties`` and invalidates cached property indices.
+  if properties.len > 0:
+    api.add_properties(tt, objectType, properties[0].unsafeAddr, properties.len.uint32)
+  invalidatePropertyIndices()
+
+proc hotReload*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o) =
+  ## Wraps ``hot_reload`` and invalidates cached property indices.
+  api.hot_reload(tt)
+  invalidatePropertyIndices()
+
+proc slotOf(c: PropertyIndexCache, objectType: uint64, nameHash: tm_strhash_t): int {.inline.} =
+  # Slot holding the key, or the empty slot where it would go.
+  let mask = c.slots.len - 1
+  var i = int((nameHash.uint64 xor (objectType * 0x9E3779B97F4A7C15'u64)) shr 32) and mask
+  while true:
+    let s = c.slots[i].addr
+    if s.objectType == 0 or (s.objectType == objectType and s.nameHash == nameHash): return i
+    i = (i + 1) and mask
+
+proc grow(c: var PropertyIndexCache) =
+  var old = move c.slots
+  c.slots = newSeq[PropertyIndexSlot](max(64, old.len * 2))
+  for s in old:
+    if s.objectType != 0:
+      c.slots[c.slotOf(s.objectType, s.nameHash)] = s
+
+proc cacheFor(tt: ptr tm_the_truth_o): ptr PropertyIndexCache =
+  for c in propertyIndexCaches.mitems:
+    if c.tt == tt:
+      result = c.addr
+      break
+  if result == nil:
+    propertyIndexCaches.add PropertyIndexCache(tt: tt)
+    result = propertyIndexCaches[^1].addr
+  if result.generation != propertyIndexGeneration:
+    result.generation = propertyIndexGeneration
+    result.slots = newSeq[PropertyIndexSlot](64)
+    result.count = 0
+
+proc lookupProperty(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, objectType: tm_tt_type_t,
+    nameHash: tm_strhash_t): ptr PropertyIndexSlot =
+  let c = cacheFor(tt)
+  let n = api.num_properties(tt, objectType)
+  var i = c[].slotOf(objectType.u64, nameHash)
+  if c.slots[i].objectType == 0 or c.slots[i].numProperties != n:
+    # Miss, or properties were added since: ask the Truth and remember the answer, including
+    # "no such property".
+    let has = api.has_property(tt, objectType, nameHash)
+    let s = PropertyIndexSlot(objectType: objectType.u64, nameHash: nameHash, index: int32(has) - 1,
+      numProperties: n)
+    if c.slots[i].objectType == 0:
+      if (c.count + 1) * 2 > c.slots.len:
+        c[].grow()
+        i = c[].slotOf(objectType.u64, nameHash)
+      inc c.count
+    c.slots[i] = s
+  c.slots[i].addr
+
+proc propertyIndex*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, objectType: tm_tt_type_t,
+    nameHash: tm_strhash_t): int =
+  ## Cached index of the property named by `nameHash` in `objectType`, -1 if there is none.
+  ## Unlike ``property_index`` a missing property can't be mistaken for index 0.
+  lookupProperty(api, tt, objectType, nameHash).index.int
+
+proc propertyDefinition*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, objectType: tm_tt_type_t,
+    nameHash: tm_strhash_t): ptr tm_the_truth_property_definition_t =
+  ## Definition of the property with a cached index, nil if there is none. Not cached itself, the
+  ## Truth's properties array moves when properties are added.
+  let i = lookupProperty(api, tt, objectType, nameHash).index
+  if i < 0: nil else: api.properties(tt, objectType) + i.int
+
+template propIndex*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, objectType: tm_tt_type_t,
+    name: static string): int =
+  ## ``propertyIndex`` with the name hashed at compile time.
+  ## Ex:
+  ## let i = truthApi.propIndex(tt, t, "cast_shadows")
+  ## if i >= 0: truthApi.set_bool(tt, w, i.uint32, true)
+  propertyIndex(api, tt, objectType, TM_STATIC_HASH(name))
+
+template propDef*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, objectType: tm_tt_type_t,
+    name: static string): ptr tm_the_truth_property_definition_t =
+  propertyDefinition(api, tt, objectType, TM_STATIC_HASH(name))
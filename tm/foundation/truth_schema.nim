@@ -0,0 +1,39 @@
+# Checks the property definitions a plugin registers against a schema compiled from a project's
+# __type_index.tm_meta with tools/tm_schema.nim. A schema property is anything with `name`, `kind`
+# (in tm_the_truth_property_type order) and `typeHash` fields, like the generated SchemaProperty.
+
+proc schemaMismatch[P](i: int, name: cstring, propType: int, typeHash: uint64,
+    schema: openArray[P], dst: var seq[string]) =
+  let s = schema[i]
+  if $name != s.name:
+    dst.add &"property {i} is `{name}`, the schema has `{s.name}`"
+  elif propType != s.kind.int:
+    dst.add &"property {i} `{name}` is of type {propType}, the schema has {s.kind.int}"
+  elif typeHash != 0 and s.typeHash != 0 and typeHash != s.typeHash:
+    dst.add &"property {i} `{name}` refers to type {typeHash:#x}, the schema to {s.typeHash:#x}"
+
+proc schemaMismatches*[P](defs: openArray[tm_the_truth_property_definition_t], schema: openArray[P]): seq[string] =
+  ## Where `defs` differ from `schema`, empty if they agree. Properties have to match by index too,
+  ## the compiled property enums are indices.
+  ## Ex:
+  ## for m in schemaMismatches(CustomComponentAsset.truthProperties, CustomComponentSchema):
+  ##   log.info(&"custom_component: {m}")
+  for i in 0 ..< min(defs.len, schema.len):
+    schemaMismatch(i, defs[i].name, defs[i].`type`.int, defs[i].type_hash.uint64, schema, result)
+  for i in schema.len ..< defs.len: result.add &"property {i} `{defs[i].name}` isn't in the schema"
+  for i in defs.len ..< schema.len: result.add &"property {i} `{schema[i].name}` isn't registered"
+
+proc schemaMismatches*[P](api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, typeHash: tm_strhash_t,
+    schema: openArray[P]): seq[string] =
+  ## Same for a type as registered in `tt`, whichever plugin registered it.
+  ## Ex:
+  ## for m in truthApi.schemaMismatches(tt, TM_TT_TYPE_HASH_TRANSFORM_COMPONENT, TransformComponentSchema): ...
+  let t = api.object_type_from_name_hash(tt, typeHash)
+  if t.u64 == 0: return @["type isn't registered"]
+  let
+    n = api.num_properties(tt, t).int
+    props = api.properties(tt, t)
+  for i, d in pairs(props, n):
+    if i < schema.len: schemaMismatch(i, d.name, d.`type`.int, d.type_hash.uint64, schema, result)
+    else: result.add &"property {i} `{d.name}` isn't in the schema"
+  for i in n ..< schema.len: result.add &"property {i} `{schema[i].name}` isn't registered"
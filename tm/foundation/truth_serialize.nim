@@ -0,0 +1,167 @@
+const
+  SerializeStreamMagic = ['T', 'M', 'N', 'S'] # followed by records: uint64 size + serialized object
+  DefaultChunkSize* = 1 shl 20
+
+type
+  SerializeArena* = object
+    ## A carray reused across ``serialize`` calls, so serializing many objects doesn't allocate a
+    ## new blob (and copy it into Nim memory) for each of them.
+    ## Ex:
+    ## var arena = initSerializeArena(truthApi.allocator(tt), 16 shl 20)
+    ## let blob = arena.serialize(truthApi, tt, prefab)
+    ## socket.send(blob.data, blob.len)
+    allocator: ptr tm_allocator_i
+    buf: ptr char
+
+  SerializedBlob* = object
+    ## Serialized data in a ``SerializeArena``. Valid until the next ``serialize`` on the arena.
+    data*: ptr UncheckedArray[char]
+    len*: int
+
+  ChunkSink* = proc (chunk: openArray[char])
+
+  ChunkedDeserializer* = object
+    ## Deserializes a stream written by ``serializeChunked`` fed in arbitrary chunks. Only the
+    ## object currently being assembled is buffered. Call ``finish`` after the last chunk.
+    api: ptr tm_the_truth_api
+    tt: ptr tm_the_truth_o
+    opts: tm_tt_deserialize_options_t
+    pending: seq[char] # bytes of the incomplete record (or header)
+    sawMagic: bool
+    objects*: seq[tm_tt_id_t] # deserialized so far, in stream order
+
+proc `=destroy`*(a: var SerializeArena) =
+  if a.buf != nil:
+    discard tm_carray_set_capacity_internal(a.buf, 0, 1, a.allocator, "truth_serialize.nim", 0)
+
+proc `=copy`*(dst: var SerializeArena, src: SerializeArena) {.error.}
+
+proc initSerializeArena*(allocator: ptr tm_allocator_i, capacity = 0): SerializeArena =
+  ## `capacity` pre-sizes the arena in bytes; it still grows if an object needs more.
+  result.allocator = allocator
+  if capacity > 0:
+    result.buf = cast[ptr char](tm_carray_set_capacity_internal(nil, capacity.uint64, 1, allocator, "truth_serialize.nim", 0))
+
+proc capacity*(a: SerializeArena): int {.inline.} =
+  tm_carray_capacity(a.buf).int
+
+proc serialize*(a: var SerializeArena, api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, o: tm_tt_id_t,
+    opts = tm_tt_serialize_options_t()): SerializedBlob =
+  ## Serializes `o` and its subobjects over the previous content of the arena.
+  if a.buf != nil: tm_carray_header(a.buf).size = 0
+  api.serialize(tt, o, a.buf.addr, a.allocator, opts.unsafeAddr)
+  SerializedBlob(data: cast[ptr UncheckedArray[char]](a.buf), len: tm_carray_size(a.buf).int)
+
+template toOpenArray*(b: SerializedBlob): openArray[char] =
+  toOpenArray(b.data, 0, b.len - 1)
+
+proc serializeChunked*(a: var SerializeArena, api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o,
+    objects: openArray[tm_tt_id_t], sink: ChunkSink, chunkSize = DefaultChunkSize,
+    opts = tm_tt_serialize_options_t()) =
+  ## Serializes `objects` one at a time into the arena and hands the stream to `sink` in chunks of
+  ## `chunkSize` bytes (the last one may be shorter). ``serialize`` produces a whole object at
+  ## once, so at most one object plus one chunk is held in memory.
+  var
+    chunk = newSeq[char](chunkSize)
+    fill = 0
+  template put(p: ptr UncheckedArray[char], n: int) =
+    var done = 0
+    while done < n:
+      let k = min(n - done, chunkSize - fill)
+      copyMem(chunk[fill].addr, p[done].addr, k)
+      fill += k
+      done += k
+      if fill == chunkSize:
+        sink(chunk)
+        fill = 0
+
+  var magic = SerializeStreamMagic
+  put(cast[ptr UncheckedArray[char]](magic[0].addr), magic.len)
+  for o in objects:
+    let blob = a.serialize(api, tt, o, opts)
+    var size = blob.len.uint64
+    put(cast[ptr UncheckedArray[char]](size.addr), sizeof(size))
+    put(blob.data, blob.len)
+  if fill > 0:
+    sink(chunk.toOpenArray(0, fill - 1))
+
+proc serializeToFile*(a: var SerializeArena, api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o,
+    objects: openArray[tm_tt_id_t], path: string, chunkSize = DefaultChunkSize,
+    opts = tm_tt_serialize_options_t()) =
+  ## ``serializeChunked`` into the file at `path`.
+  var f = open(path, fmWrite)
+  defer: f.close()
+  let sink = proc (chunk: openArray[char]) =
+    if f.writeBuffer(chunk[0].unsafeAddr, chunk.len) != chunk.len:
+      raise newException(IOError, "failed writing " & path)
+  a.serializeChunked(api, tt, objects, sink, chunkSize, opts)
+
+proc initChunkedDeserializer*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o,
+    opts = tm_tt_deserialize_options_t()): ChunkedDeserializer =
+  ChunkedDeserializer(api: api, tt: tt, opts: opts)
+
+proc deserializeAt(d: var ChunkedDeserializer, p: ptr char) =
+  var cursor = cast[cstring](p)
+  d.objects.add d.api.deserialize(d.tt, cursor.addr, d.opts.addr)
+
+proc feed*(d: var ChunkedDeserializer, chunk: openArray[char]) =
+  ## Consumes `chunk` and deserializes every object it completes. Records that are entirely inside
+  ## `chunk` are deserialized in place without copying.
+  var pos = 0
+  template take(n: int): bool =
+    # Appends up to `n - pending.len` bytes to `pending`; *true* once it holds `n` bytes.
+    let k = min(n - d.pending.len, chunk.len - pos)
+    if k > 0:
+      let old = d.pending.len
+      d.pending.setLen(old + k)
+      copyMem(d.pending[old].addr, chunk[pos].unsafeAddr, k)
+      pos += k
+    d.pending.len == n
+
+  if not d.sawMagic:
+    if not take(SerializeStreamMagic.len): return
+    if d.pending != @SerializeStreamMagic:
+      raise newException(ValueError, "not a serialized Truth stream")
+    d.pending.setLen(0)
+    d.sawMagic = true
+
+  while pos < chunk.len or d.pending.len > 0:
+    # Fast path: the whole record is in this chunk.
+    if d.pending.len == 0 and chunk.len - pos >= sizeof(uint64):
+      var size: uint64
+      copyMem(size.addr, chunk[pos].unsafeAddr, sizeof(size))
+      if chunk.len - pos - sizeof(size) >= size.int:
+        d.deserializeAt(chunk[pos + sizeof(size)].unsafeAddr)
+        pos += sizeof(size) + size.int
+        continue
+
+    # Record spans chunks: assemble it in `pending`.
+    if not take(sizeof(uint64)): return
+    var size: uint64
+    copyMem(size.addr, d.pending[0].addr, sizeof(size))
+    if not take(sizeof(uint64) + size.int): return
+    d.deserializeAt(d.pending[sizeof(uint64)].addr)
+    d.pending.setLen(0)
+
+proc finish*(d: ChunkedDeserializer) =
+  ## Raises ValueError if the stream ended before its header or in the middle of a record.
+  if not d.sawMagic:
+    raise newException(ValueError, "truncated serialized Truth stream: no header")
+  if d.pending.len > 0:
+    raise newException(ValueError, &"truncated serialized Truth stream: {d.pending.len} bytes of an incomplete record")
+
+proc deserializeFile*(api: ptr tm_the_truth_api, tt: ptr tm_the_truth_o, path: string,
+    chunkSize = DefaultChunkSize, opts = tm_tt_deserialize_options_t()): seq[tm_tt_id_t] =
+  ## Reads a file written by ``serializeToFile`` in `chunkSize` pieces and returns the objects.
+  ## Raises ValueError if the file isn't one or is truncated.
+  var
+    d = initChunkedDeserializer(api, tt, opts)
+    chunk = newSeq[char](chunkSize)
+    f = open(path, fmRead)
+  defer: f.close()
+  while true:
+    let n = f.readBuffer(chunk[0].addr, chunkSize)
+    if n <= 0: break
+    d.feed(chunk.toOpenArray(0, n - 1))
+  d.finish()
+  move d.objects
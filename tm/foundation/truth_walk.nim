@@ -0,0 +1,44 @@
+type
+  TruthWalkSource* = object
+    ## ``parallelWalk`` source for a Truth: the children of an object are the members of its
+    ## subobject properties and sets, plus its references and reference sets if
+    ## `followReferences`. Reads are thread-safe snapshots, so workers share the Truth directly and
+    ## each set is fetched with a temp allocator on the worker's stack.
+    api*: ptr tm_the_truth_api
+    taApi*: ptr tm_temp_allocator_api
+    tt*: ptr tm_the_truth_o
+    followReferences*: bool
+
+proc initTruthWalkSource*(api: ptr tm_the_truth_api, taApi: ptr tm_temp_allocator_api, tt: ptr tm_the_truth_o,
+    followReferences = true): TruthWalkSource =
+  TruthWalkSource(api: api, taApi: taApi, tt: tt, followReferences: followReferences)
+
+proc children*(s: TruthWalkSource, id: uint64, dst: var seq[uint64]) =
+  let
+    o = tm_tt_id_t(u64: id)
+    r = s.api.read(s.tt, o)
+  if r == nil: return
+  let
+    t: tm_tt_type_t = o
+    n = s.api.num_properties(s.tt, t)
+    props = s.api.properties(s.tt, t)
+  for i, p in pairs(props, n):
+    let prop = uint32(i)
+    case p.`type`:
+      of TM_THE_TRUTH_PROPERTY_TYPE_SUBOBJECT:
+        let c = s.api.get_subobject(s.tt, r, prop)
+        if c.u64 != 0: dst.add c.u64
+      of TM_THE_TRUTH_PROPERTY_TYPE_REFERENCE:
+        if s.followReferences:
+          let c = s.api.get_reference(s.tt, r, prop)
+          if c.u64 != 0: dst.add c.u64
+      of TM_THE_TRUTH_PROPERTY_TYPE_SUBOBJECT_SET:
+        var ta = s.taApi.init()
+        for c in carray_items(s.api.get_subobject_set(s.tt, r, prop, ta)):
+          dst.add c.u64
+      of TM_THE_TRUTH_PROPERTY_TYPE_REFERENCE_SET:
+        if s.followReferences:
+          var ta = s.taApi.init()
+          for c in carray_items(s.api.get_reference_set(s.tt, r, prop, ta)):
+            dst.add c.u64
+      else: discard
@@ -0,0 +1,54 @@
+type
+  ComponentRefSlot = object
+    ctx: ptr tm_entity_context_o
+    generation: uint32
+    t: tm_component_type_t
+
+  ComponentRef*[T] = object
+    ## Typed handle to a component, declared by name and resolved with ``lookup_component_type``
+    ## once per entity context instead of hashing/looking up every frame.
+    ## Ex:
+    ## var transformRef = componentRef(tm_transform_component_t, TM_TT_TYPE_HASH_TRANSFORM_COMPONENT)
+    ## var customRef = componentRef(CustomComponentT, "custom_component")
+    ## ...
+    ## let tr = transformRef.get(entity_api, ctx, e)
+    name*: tm_strhash_t
+    slots: array[4, ComponentRefSlot] # one per recently used entity context
+    next: uint8
+
+var componentRefGeneration = 1'u32 # 0 marks an empty slot
+
+proc invalidateComponentRefs*() {.inline.} =
+  ## Drops every resolved ``ComponentRef``. ``createComponents`` calls this; call it yourself if
+  ## components are registered or a context is destroyed some other way.
+  inc componentRefGeneration
+
+proc createComponents*(api: ptr tm_entity_api, ctx: ptr tm_entity_context_o, flags: tm_entity_create_components) =
+  ## Wraps ``create_components`` and invalidates cached component types.
+  api.create_components(ctx, flags)
+  invalidateComponentRefs()
+
+template componentRef*(T: typedesc, name: static string): untyped =
+  ComponentRef[T](name: TM_STATIC_HASH(name))
+
+template componentRef*(T: typedesc, hash: tm_strhash_t): untyped =
+  ComponentRef[T](name: hash)
+
+proc resolve*[T](r: var ComponentRef[T], api: ptr tm_entity_api, ctx: ptr tm_entity_context_o): tm_component_type_t {.inline.} =
+  ## Returns the component type in `ctx`, looking it up only the first time `ctx` is seen.
+  for s in r.slots:
+    if s.ctx == ctx and s.generation == componentRefGeneration:
+      return s.t
+  result = api.lookup_component_type(ctx, r.name)
+  r.slots[r.next] = ComponentRefSlot(ctx: ctx, generation: componentRefGeneration, t: result)
+  r.next = (r.next + 1) mod r.slots.len.uint8
+
+proc get*[T](r: var ComponentRef[T], api: ptr tm_entity_api, ctx: ptr tm_entity_context_o, e: tm_entity_t): ptr T {.inline.} =
+  ## ``get_component`` with the cached type. Returns nil if `e` doesn't have the component.
+  cast[ptr T](api.get_component(ctx, e, r.resolve(api, ctx)))
+
+proc add*[T](r: var ComponentRef[T], api: ptr tm_entity_api, ctx: ptr tm_entity_context_o, e: tm_entity_t): ptr T {.inline.} =
+  cast[ptr T](api.add_component(ctx, e, r.resolve(api, ctx)))
+
+proc remove*[T](r: var ComponentRef[T], api: ptr tm_entity_api, ctx: ptr tm_entity_context_o, e: tm_entity_t) {.inline.} =
+  api.remove_component(ctx, e, r.resolve(api, ctx))
@@ -0,0 +1,121 @@
+const
+  BlackboardMaxIds = 32
+  BlackboardMaxBits = 6 # table of 2 * BlackboardMaxIds entries
+
+type
+  BlackboardHash* = object
+    ## Perfect hash over a fixed set of blackboard IDs: `(id shr shift) and mask` is unique for
+    ## every ID and indexes `table`, which holds the position of the ID in the set (or -1).
+    shift*: int
+    mask*: uint64
+    table*: array[1 shl BlackboardMaxBits, int8]
+
+proc blackboardHash*(ids: openArray[uint64]): BlackboardHash =
+  ## Finds a perfect hash for `ids`. Meant to be evaluated at compile time.
+  doAssert ids.len <= BlackboardMaxIds, "too many blackboard ids"
+  var bits = 0
+  while (1 shl bits) < ids.len * 2: inc bits
+  while bits <= BlackboardMaxBits:
+    result.mask = uint64((1 shl bits) - 1)
+    for shift in 0 .. 63:
+      result.shift = shift
+      for t in result.table.mitems: t = -1
+      var ok = true
+      for i, id in ids:
+        let h = int((id shr shift) and result.mask)
+        if result.table[h] != -1:
+          ok = false
+          break
+        result.table[h] = int8(i)
+      if ok: return
+    inc bits
+  doAssert false, "no perfect hash for blackboard ids"
+
+macro blackboard*(name: untyped, body: untyped): untyped =
+  ## Declares an object holding the blackboard values an engine needs, plus a ``read`` proc that
+  ## fills it from a ``tm_engine_update_set_t``. The IDs are resolved with a compile-time perfect
+  ## hash in a single pass over the blackboard, and the positions found are reused on the next
+  ## frames as long as the blackboard layout doesn't change. While an ID is missing from the
+  ## blackboard every ``read`` rescans it, so it is picked up as soon as it appears. Engine updates
+  ## of different entity contexts can run at the same time on job threads, so keep the object in
+  ## per-engine state or a local, not a global.
+  ## Ex:
+  ## blackboard EngineBlackboard:
+  ##   time: float64 = TM_ENTITY_BB_TIME
+  ##   deltaTime: float64 = TM_ENTITY_BB_DELTA_TIME
+  ##   ui: ptr tm_ui_o = TM_ENTITY_BB_UI
+  ##
+  ## proc update(inst: ptr tm_engine_o, data: ptr tm_engine_update_set_t, commands: ptr tm_entity_commands_o) {.cdecl.} =
+  ##   var bb: EngineBlackboard
+  ##   bb.read(data)
+  ##   let t = bb.time
+  var fields: seq[tuple[name, T, id: NimNode]]
+  for n in body:
+    case n.kind:
+      of nnkCall: # time: float64 = TM_ENTITY_BB_TIME
+        assert(n.len == 2 and n[1].kind == nnkStmtList and n[1][0].kind == nnkAsgn, &"expected `field: type = id`, got: {n.repr}")
+        fields.add (n[0], n[1][0][0], n[1][0][1])
+      of nnkAsgn: # time = TM_ENTITY_BB_TIME
+        fields.add (n[0], ident("float64"), n[1])
+      of nnkCommentStmt: discard
+      else:
+        raise newException(Defect, &"expected `field: type = id`, got: {n.repr}")
+
+  let count = fields.len
+  var
+    recList = newNimNode(nnkRecList)
+    ids = newNimNode(nnkBracket)
+    reads = newStmtList()
+  let
+    bb = ident("bb")
+    values = ident("values")
+  for i in 0 ..< count:
+    let (field, T, id) = fields[i]
+    recList.add newIdentDefs(postfix(field, "*"), T)
+    ids.add newCall(ident("uint64"), id)
+    let isDouble = T.repr in ["float", "float64", "float32", "cdouble", "cfloat"]
+    reads.add genAst(bb, values, field, T, i, isDouble) do:
+      let p = bb.positions[i]
+      bb.field =
+        if p < 0: default(T)
+        else:
+          when isDouble: T(values[p].double_value)
+          else: cast[T](values[p].ptr_value)
+  recList.add newIdentDefs(ident("positions"), nnkBracketExpr.newTree(ident("array"), newLit(count), ident("int32")))
+  recList.add newIdentDefs(ident("layoutLen"), ident("int"))
+
+  let typeDef = nnkTypeSection.newTree(nnkTypeDef.newTree(postfix(name, "*"), newEmptyNode(),
+    nnkObjectTy.newTree(newEmptyNode(), newEmptyNode(), recList)))
+
+  let readProc = genAst(name, bb, values, ids, reads, count):
+    proc read*(bb: var name, data: ptr tm_engine_update_set_t) =
+      const
+        idList = ids
+        ph = blackboardHash(idList)
+      let
+        values = cast[ptr UncheckedArray[tm_entity_blackboard_value_t]](data.blackboard_start)
+        n = (cast[int](data.blackboard_end) - cast[int](data.blackboard_start)) div sizeof(tm_entity_blackboard_value_t)
+
+      # Same length and every ID found at its cached slot: reuse the positions. A missing ID may
+      # have appeared since, so it always means a rescan.
+      var valid = n > 0 and n == bb.layoutLen
+      if valid:
+        for i in 0 ..< count:
+          let p = bb.positions[i]
+          if p < 0 or values[p].id.uint64 != idList[i]:
+            valid = false
+            break
+
+      if not valid:
+        bb.layoutLen = n
+        for p in bb.positions.mitems: p = -1
+        for p in 0 ..< n:
+          let
+            id = values[p].id.uint64
+            i = ph.table[int((id shr ph.shift) and ph.mask)]
+          if i >= 0 and idList[i.int] == id:
+            bb.positions[i.int] = int32(p)
+
+      reads
+
+  result = newStmtList(typeDef, readProc)
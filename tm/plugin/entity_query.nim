@@ -0,0 +1,103 @@
+type
+  EntityQuery* = object
+    ## Caches the entities matching a component mask across frames. Replaces calling
+    ## ``entities_matching`` + ``flatten_set`` every tick: the flat entity list is only rebuilt
+    ## when the entity count or the set of matching archetypes changes.
+    ##
+    ## The entity API has no change counter, so ``update`` only notices changes through
+    ## ``num_entities``. It misses edits that keep the count: destroying and creating as many
+    ## entities in one frame, and adding or removing components, which moves entities to other
+    ## (possibly new) archetypes. Call ``invalidate`` after those.
+    api: ptr tm_entity_api
+    taApi: ptr tm_temp_allocator_api
+    ctx: ptr tm_entity_context_o
+    required, forbidden: tm_component_mask_t
+    withForbidden: bool
+    dirty: bool
+    numEntities: uint32 # num_entities() of the context when the cache was last refreshed
+    archetypes: seq[tm_component_mask_t] # component mask of each array in `arrays`
+    arrays: seq[tm_entity_array_t]
+    entities: seq[tm_entity_t]
+
+proc initEntityQuery*(api: ptr tm_entity_api, taApi: ptr tm_temp_allocator_api, ctx: ptr tm_entity_context_o,
+    required: openArray[tm_component_type_t], forbidden: openArray[tm_component_type_t] = []): EntityQuery =
+  ## Ex:
+  ## s.movers = initEntityQuery(entity_api, temp_allocator_api, s.entity_ctx, [s.mover_component, s.transform_component])
+  result = EntityQuery(api: api, taApi: taApi, ctx: ctx, dirty: true)
+  for c in required:
+    tm_entity_mask_add_component(result.required.addr, c)
+  for c in forbidden:
+    tm_entity_mask_add_component(result.forbidden.addr, c)
+  result.withForbidden = forbidden.len > 0
+
+proc invalidate*(q: var EntityQuery) {.inline.} =
+  ## Forces a refresh on the next ``update``. Call this after adding or removing components on
+  ## existing entities, since that moves entities between archetypes without changing the count.
+  q.dirty = true
+
+proc sameArrays(q: EntityQuery, s: ptr tm_entity_set_t): bool =
+  if s.num_arrays.int != q.arrays.len: return false
+  for i, a in pairs(s.arrays, s.num_arrays):
+    if a.entities != q.arrays[i].entities or a.n != q.arrays[i].n: return false
+  true
+
+proc update*(q: var EntityQuery): bool {.discardable.} =
+  ## Refreshes the cache if the context changed since the last call. Returns *true* if the
+  ## matching entities were rebuilt.
+  let n = q.api.num_entities(q.ctx)
+  if n == q.numEntities and not q.dirty: return false
+  q.numEntities = n
+  q.dirty = false
+
+  var ta = q.taApi.init()
+  let s =
+    if q.withForbidden: q.api.entities_matching_with_forbidden(q.ctx, q.required.addr, q.forbidden.addr, ta)
+    else: q.api.entities_matching(q.ctx, q.required.addr, ta)
+  if sameArrays(q, s): return false
+
+  # Only arrays we haven't seen before need their archetype mask looked up. Empty arrays have no
+  # entity to look it up from and get an empty mask.
+  var archetypes = newSeqOfCap[tm_component_mask_t](s.num_arrays.int)
+  for a in items(s.arrays, s.num_arrays):
+    var found = -1
+    for j, old in q.arrays:
+      if old.entities == a.entities and old.n > 0:
+        found = j
+        break
+    archetypes.add(
+      if found >= 0: q.archetypes[found]
+      elif a.n > 0: q.api.component_mask(q.ctx, a.entities[0])[]
+      else: tm_component_mask_t())
+  q.archetypes = move archetypes
+
+  q.arrays.setLen(s.num_arrays.int)
+  for i, a in pairs(s.arrays, s.num_arrays):
+    q.arrays[i] = a
+
+  q.entities.setLen(s.total_entities.int)
+  if s.total_entities > 0:
+    q.api.flatten_set(q.entities[0].addr, s)
+  true
+
+proc len*(q: EntityQuery): int {.inline.} =
+  q.entities.len
+
+proc numArchetypes*(q: EntityQuery): int {.inline.} =
+  q.arrays.len
+
+proc archetype*(q: EntityQuery, i: int): lent tm_component_mask_t {.inline.} =
+  ## Component mask shared by all the entities in array `i`, empty if the array is.
+  q.archetypes[i]
+
+proc entities*(q: EntityQuery): lent seq[tm_entity_t] {.inline.} =
+  q.entities
+
+iterator items*(q: EntityQuery): tm_entity_t =
+  ## Iterates the cached entities without allocating. Call ``update`` first.
+  for e in q.entities:
+    yield e
+
+iterator arrays*(q: EntityQuery): lent tm_entity_array_t =
+  ## Iterates the cached contiguous arrays, one per matching archetype.
+  for a in q.arrays:
+    yield a
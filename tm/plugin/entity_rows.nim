@@ -0,0 +1,22 @@
+type
+  ComponentStreams* = set[0 .. 31] # indices into tm_engine_update_array_t.components (TM_MAX_COMPONENTS_FOR_ENGINE)
+
+const AllComponentStreams* = {0 .. 31}
+
+iterator prefetchRows*(a: tm_engine_update_array_t, streams: ComponentStreams = AllComponentStreams,
+    entities = true, distance: static int = 8): int =
+  ## Yields the row indices of `a` while prefetching `distance` rows ahead on the component arrays
+  ## in `streams` (stepping by ``component_bytes``) and on ``a.entities``. Leave read-only
+  ## components the loop doesn't touch out of `streams` so they don't use up cache.
+  ## Ex:
+  ## for a in items(data.arrays, data.numArrays):
+  ##   let transform = cast[ptr tm_transform_component_t](a.components[1])
+  ##   for i in prefetchRows(a, {1}, entities = false):
+  ##     inc transform[i].version
+  var s = initPrefetchStreams[33](a.n.int)
+  for k in streams:
+    s.add(a.components[k], a.component_bytes[k].int)
+  if entities:
+    s.add(a.entities, sizeof(tm_entity_t))
+  for i in s.rows(distance):
+    yield i
@@ -0,0 +1,84 @@
+type
+  SpawnInit*[T] = proc (i: int, e: tm_entity_t, c: ptr T)
+  CommandSpawnInit*[T] = proc (i: int, h: tm_entity_command_entity_handle_t, c: ptr T)
+
+proc initBatch[T](api: ptr tm_entity_api, taApi: ptr tm_temp_allocator_api, ctx: ptr tm_entity_context_o,
+    es: openArray[tm_entity_t], component: tm_component_type_t, init: SpawnInit[T]) =
+  # Entities created by one batch call are appended to the same archetype, so instead of calling
+  # `get_component()` for every entity we find the run in the archetype's entity array and step
+  # through the component data with a fixed stride.
+  assert(api.component(ctx, component).bytes == sizeu32(T), "component size doesn't match " & $T)
+  var
+    ta = taApi.init()
+    done = 0
+  let s = api.entities_matching(ctx, api.component_mask(ctx, es[0]), ta)
+  for a in items(s.arrays, s.num_arrays):
+    if done == es.len: break
+    let n = a.n.int
+    # The batch is normally at the end of the array, check there before searching.
+    var j = n - (es.len - done)
+    if j < 0 or a.entities[j].u64 != es[done].u64:
+      j = -1
+      for k in 0 ..< n:
+        if a.entities[k].u64 == es[done].u64:
+          j = k
+          break
+    if j < 0: continue
+
+    let base = cast[ptr T](api.get_component(ctx, es[done], component))
+    var k = j
+    while k < n and done < es.len and a.entities[k].u64 == es[done].u64:
+      init(done, es[done], base + (k - j))
+      inc k
+      inc done
+
+  # Anything that didn't end up in a contiguous run.
+  for i in done ..< es.len:
+    init(i, es[i], cast[ptr T](api.get_component(ctx, es[i], component)))
+
+proc spawn*[T](api: ptr tm_entity_api, taApi: ptr tm_temp_allocator_api, ctx: ptr tm_entity_context_o,
+    asset: tm_tt_id_t, count: int, component: tm_component_type_t, init: SpawnInit[T]): seq[tm_entity_t] =
+  ## Creates `count` entities from `asset` with a single ``batch_create_entity_from_asset`` call and
+  ## calls `init` once per entity with its `component` data.
+  ## Ex:
+  ## let wave = entity_api.spawn(temp_allocator_api, s.entity_ctx, enemy_asset, 10_000, s.transform_component,
+  ##   proc (i: int, e: tm_entity_t, tr: ptr tm_transform_component_t) =
+  ##     tr.world.pos = vec3(x = float(i mod 100), z = float(i div 100)))
+  result = newSeq[tm_entity_t](count)
+  if count == 0: return
+  api.batch_create_entity_from_asset(ctx, asset, result[0].addr, count.uint32)
+  if init != nil:
+    initBatch(api, taApi, ctx, result, component, init)
+
+proc spawn*[T](api: ptr tm_entity_api, taApi: ptr tm_temp_allocator_api, ctx: ptr tm_entity_context_o,
+    mask: tm_component_mask_t, count: int, component: tm_component_type_t, init: SpawnInit[T]): seq[tm_entity_t] =
+  ## As ``spawn`` above, but creates the entities from a component mask with
+  ## ``batch_create_entity_from_mask``.
+  result = newSeq[tm_entity_t](count)
+  if count == 0: return
+  api.batch_create_entity_from_mask(ctx, mask.unsafeAddr, result[0].addr, count.uint32)
+  if init != nil:
+    initBatch(api, taApi, ctx, result, component, init)
+
+proc spawn*[T](api: ptr tm_entity_commands_api, commands: ptr tm_entity_commands_o, mask: tm_component_mask_t,
+    count: int, component: tm_component_type_t, ta: ptr tm_temp_allocator_i,
+    init: CommandSpawnInit[T]): ptr tm_entity_command_entity_handle_t =
+  ## Queues the creation of `count` entities from `mask` and calls `init` with the zero-initialized
+  ## `component` data of each, which is copied into the entity when `commands` is synchronized.
+  ## Returns the carray of handles allocated with `ta`. Safe to use from an engine update.
+  if count == 0: return
+  result = api.batch_create_entity_from_mask(commands, mask.unsafeAddr, count.uint32, ta)
+  if init != nil:
+    for i, h in pairs(result, tm_carray_size(result)):
+      init(i, h, cast[ptr T](api.add_component_by_handle(commands, h, component)))
+
+proc spawn*(api: ptr tm_entity_commands_api, commands: ptr tm_entity_commands_o, asset: tm_tt_id_t,
+    count: int, ta: ptr tm_temp_allocator_i): ptr tm_entity_command_entity_handle_t =
+  ## As above, but queues ``batch_create_entity_from_asset`` for `count` copies of `asset`. There is
+  ## no `init`: ``add_component_by_handle`` would replace the asset's component data with zeroes.
+  ## Set components with ``get_component`` once `commands` is synchronized instead.
+  if count == 0: return
+  var assets = newSeq[tm_tt_id_t](count)
+  for a in assets.mitems:
+    a = asset
+  result = api.batch_create_entity_from_asset(commands, assets[0].addr, count.uint32, ta)
@@ -1,8 +1,20 @@
 import std / [
   macros, 
   genasts, 
-  strformat
+  strformat,
+  strutils,
+  sequtils,
+  algorithm,
+  tables,
+  sets,
+  atomics,
+  cpuinfo,
+  os
   ]
+when compileOption("threads"):
+  import std / locks
+  when (NimMajor, NimMinor) >= (1, 9):
+    import std / typedthreads
 import ptr_math, genit, nillean
 export ptr_math, genit, nillean
 
@@ -33,8 +45,27 @@ include foundation / [
   allocator, 
   temp_allocator,
   localizer,
+  strhash_cache,
+  carray,
+  prefetch,
+  buffer_view,
   the_truth,
-  carray
+  truth_object,
+  truth_schema,
+  truth_cache,
+  truth_path,
+  truth_property_index,
+  truth_serialize,
+  parallel_walk,
+  truth_walk,
+  truth_memory_profiler
   ]
 
-include plugin / [ entity ]
\ No newline at end of file
+include plugin / [
+  entity,
+  entity_query,
+  entity_spawn,
+  component_ref,
+  entity_blackboard,
+  entity_rows
+  ]
\ No newline at end of file
@@ -0,0 +1,370 @@
+# Blockwise LZ4 compression of buffers. The 16-byte header is `tm_buffer_compressed_header_t` from
+# buffer.h: the "LZ4BLOC" cookie and the uncompressed size, followed by the buffer in blocks of
+# TM_BUFFER_COMPRESSED_LZ4_BLOCK_SIZE. buffer.h doesn't define how the blocks are framed, so the
+# framing is this tool's own: each block is a little-endian uint32 size followed by the block in
+# the LZ4 block format, or stored as is when it doesn't compress (top bit of the size set). It
+# hasn't been checked against buffers the engine wrote and may not read them.
+# Blocks are independent, so they are (de)compressed in parallel and any one of them can be read on
+# its own. Files are processed a batch of blocks at a time and never have to fit in memory.
+# Run with `nimble lz4blocks -- compress|decompress <input> <output>`.
+import std / [os, memfiles, strformat, monotimes, times]
+import work_pool
+
+const
+  LZ4BlockCookie* = ['L', 'Z', '4', 'B', 'L', 'O', 'C', '\0']
+  LZ4BlockSize* = 1024 * 1024
+  StoredBlock = 0x8000_0000'u32 # size flag: the block is not compressed
+
+  MinMatch = 4
+  LastLiterals = 5 # the last bytes of a block are always literals
+  MfLimit = 12 # no match starts in the last bytes of a block
+  MaxDistance = 65535
+  HashLog = 16
+
+type
+  CompressedHeader* = object
+    ## `tm_buffer_compressed_header_t`.
+    magicCookie*: array[8, char]
+    uncompressedSize*: uint64
+
+  Bytes = ptr UncheckedArray[byte]
+
+  LZ4Blocks* = object
+    ## Block index of a compressed buffer, in memory or mapped from a file.
+    mem: MemFile
+    mapped: bool
+    data: Bytes
+    size: int
+    uncompressedSize*: int64
+    offsets: seq[int] # of each block's size prefix
+
+  BlockJob = object
+    src: Bytes # compress: the uncompressed input
+    srcLen: int
+    blocks: ptr LZ4Blocks # decompress: the compressed input
+    dst: Bytes # decompress: output of block `first`
+    first: int # block of item 0
+    outs: seq[seq[byte]] # compress: size prefix and block, per item
+    errors: seq[string] # per item
+
+proc bytes(a: openArray[byte]): Bytes {.inline.} =
+  if a.len > 0: cast[Bytes](a[0].unsafeAddr) else: nil
+
+proc read32(p: Bytes, i: int): uint32 {.inline.} =
+  copyMem(result.addr, p[i].addr, 4)
+
+proc write32(p: Bytes, i: int, x: uint32) {.inline.} =
+  var x = x
+  copyMem(p[i].addr, x.addr, 4)
+
+proc isLZ4Compressed*(data: openArray[byte]): bool =
+  ## Whether `data` starts with the LZ4BLOC header. Uncompressed buffers never do.
+  if data.len < sizeof(CompressedHeader): return false
+  for i, c in LZ4BlockCookie:
+    if data[i] != c.byte: return false
+  true
+
+proc blockCount*(uncompressedSize: int64): int =
+  int((uncompressedSize + LZ4BlockSize - 1) div LZ4BlockSize)
+
+# --- LZ4 block format ----------------------------------------------------------------------------
+
+proc compressBound*(n: int): int =
+  ## Largest LZ4 block `n` bytes can compress to.
+  n + n div 255 + 16
+
+proc hash4(x: uint32): int {.inline.} =
+  int((x * 2654435761'u32) shr (32 - HashLog))
+
+proc emitLength(d: Bytes, op: var int, n: int) {.inline.} =
+  # Length beyond the 15 of the token nibble.
+  var n = n - 15
+  while n >= 255:
+    d[op] = 255
+    inc op
+    n -= 255
+  d[op] = byte(n)
+  inc op
+
+proc emitSequence(d, s: Bytes, op: var int, lit, litLen, matchLen, offset: int) {.inline.} =
+  # Token, literals and, except for the last sequence of a block, the match.
+  let token = d[op].addr
+  inc op
+  token[] = byte(min(litLen, 15) shl 4)
+  if litLen >= 15: emitLength(d, op, litLen)
+  if litLen > 0:
+    copyMem(d[op].addr, s[lit].addr, litLen)
+    op += litLen
+  if matchLen == 0: return
+  d[op] = byte(offset and 0xff)
+  d[op + 1] = byte(offset shr 8)
+  op += 2
+  token[] = token[] or byte(min(matchLen - MinMatch, 15))
+  if matchLen - MinMatch >= 15: emitLength(d, op, matchLen - MinMatch)
+
+proc lz4CompressBlock*(src: openArray[byte], dst: var openArray[byte]): int =
+  ## Compresses `src` to `dst` in the LZ4 block format, which `dst` must have compressBound bytes
+  ## for. Returns the compressed size.
+  ## Ex:
+  ## var dst = newSeq[byte](compressBound(src.len))
+  ## dst.setLen(lz4CompressBlock(src, dst))
+  assert dst.len >= compressBound(src.len)
+  let
+    n = src.len
+    s = bytes(src)
+    d = cast[Bytes](dst[0].addr)
+  var
+    op, anchor = 0
+    table = newSeq[int32](1 shl HashLog)
+
+  if n > MfLimit:
+    let
+      matchLimit = n - LastLiterals
+      ipLimit = n - MfLimit
+    var ip = 1
+    while ip <= ipLimit:
+      let
+        h = hash4(read32(s, ip))
+        candidate = table[h].int
+      table[h] = int32(ip)
+      if ip - candidate > MaxDistance or read32(s, candidate) != read32(s, ip):
+        ip += 1 + (ip - anchor) shr 6 # skip faster through data that doesn't match
+        continue
+      var
+        start = ip
+        back = candidate
+      while start > anchor and back > 0 and s[start - 1] == s[back - 1]:
+        dec start
+        dec back
+      var len = ip - start + MinMatch
+      while start + len < matchLimit and s[start + len] == s[back + len]: inc len
+      emitSequence(d, s, op, anchor, start - anchor, len, start - back)
+      ip = start + len
+      anchor = ip
+      if ip - 2 <= ipLimit: table[hash4(read32(s, ip - 2))] = int32(ip - 2)
+  emitSequence(d, s, op, anchor, n - anchor, 0, 0)
+  op
+
+proc corrupt() {.noreturn.} =
+  raise newException(IOError, "corrupt LZ4 block")
+
+proc readLength(s: Bytes, n: int, ip: var int, len: var int) {.inline.} =
+  while true:
+    if ip >= n: corrupt()
+    let b = s[ip]
+    inc ip
+    len += b.int
+    if b != 255: break
+
+proc lz4DecompressBlock*(src: openArray[byte], dst: var openArray[byte]): int =
+  ## Decompresses the LZ4 block `src` to `dst` and returns the decompressed size. Raises IOError if
+  ## `src` is malformed or doesn't fit in `dst`.
+  let
+    n = src.len
+    s = bytes(src)
+    d = if dst.len > 0: cast[Bytes](dst[0].addr) else: nil
+  var ip, op = 0
+  while true:
+    if ip >= n: corrupt()
+    let token = s[ip]
+    inc ip
+    var lit = int(token shr 4)
+    if lit == 15: readLength(s, n, ip, lit)
+    if ip + lit > n or op + lit > dst.len: corrupt()
+    if lit > 0:
+      copyMem(d[op].addr, s[ip].addr, lit)
+      ip += lit
+      op += lit
+    if ip == n: break # the last sequence has no match
+    if ip + 2 > n: corrupt()
+    let offset = s[ip].int or (s[ip + 1].int shl 8)
+    ip += 2
+    if offset == 0 or offset > op: corrupt()
+    var len = int(token and 15)
+    if len == 15: readLength(s, n, ip, len)
+    len += MinMatch
+    if op + len > dst.len: corrupt()
+    if offset >= len:
+      copyMem(d[op].addr, d[op - offset].addr, len)
+    else:
+      for k in 0 ..< len: d[op + k] = d[op - offset + k] # overlapping, repeats the last `offset` bytes
+    op += len
+  op
+
+# --- Blocks --------------------------------------------------------------------------------------
+
+proc compressBlock(job: ptr BlockJob, i, worker: int) {.nimcall, gcsafe.} =
+  let
+    start = (job.first + i) * LZ4BlockSize
+    len = min(LZ4BlockSize, job.srcLen - start)
+  var o = newSeq[byte](4 + compressBound(len))
+  var size = lz4CompressBlock(toOpenArray(job.src, start, start + len - 1), toOpenArray(o, 4, o.high))
+  if size >= len:
+    copyMem(o[4].addr, job.src[start].addr, len)
+    size = len
+    write32(bytes(o), 0, uint32(len) or StoredBlock)
+  else:
+    write32(bytes(o), 0, uint32(size))
+  o.setLen(4 + size)
+  job.outs[i] = move o
+
+proc header(uncompressedSize: int64): CompressedHeader =
+  CompressedHeader(magicCookie: LZ4BlockCookie, uncompressedSize: uint64(uncompressedSize))
+
+proc compressBuffer*(src: openArray[byte], workers = 0): seq[byte] =
+  ## Compresses `src` in LZ4BLOC blocks, on `workers` threads.
+  let n = blockCount(src.len)
+  var job = BlockJob(src: bytes(src), srcLen: src.len, outs: newSeq[seq[byte]](n))
+  parallelFor(job.addr, n, compressBlock, workers)
+  var size = sizeof(CompressedHeader)
+  for o in job.outs: size += o.len
+  result = newSeq[byte](size)
+  var h = header(src.len)
+  copyMem(result[0].addr, h.addr, sizeof(h))
+  var pos = sizeof(h)
+  for o in job.outs:
+    copyMem(result[pos].addr, o[0].unsafeAddr, o.len)
+    pos += o.len
+
+proc initLZ4Blocks*(data: Bytes, size: int): LZ4Blocks =
+  ## Indexes the compressed buffer at `data`, which has to outlive the result. Only the block sizes
+  ## are read. Raises IOError if it isn't a complete LZ4BLOC buffer.
+  result.data = data
+  result.size = size
+  if not isLZ4Compressed(toOpenArray(data, 0, size - 1)):
+    raise newException(IOError, "not an LZ4BLOC buffer")
+  var h: CompressedHeader
+  copyMem(h.addr, data, sizeof(h))
+  result.uncompressedSize = int64(h.uncompressedSize)
+  let n = blockCount(result.uncompressedSize)
+  result.offsets = newSeq[int](n)
+  var pos = sizeof(h)
+  for i in 0 ..< n:
+    if pos + 4 > size: raise newException(IOError, "truncated LZ4BLOC buffer")
+    result.offsets[i] = pos
+    pos += 4 + int(read32(data, pos) and not StoredBlock)
+  if pos != size: raise newException(IOError, "truncated LZ4BLOC buffer")
+
+proc openLZ4Blocks*(path: string): LZ4Blocks =
+  ## Maps the compressed buffer file at `path` and indexes its blocks.
+  var mem = memfiles.open(path)
+  try:
+    result = initLZ4Blocks(cast[Bytes](mem.mem), mem.size)
+  except IOError:
+    mem.close()
+    raise
+  result.mem = mem
+  result.mapped = true
+
+proc close*(b: var LZ4Blocks) =
+  if b.mapped:
+    b.mem.close()
+    b.mapped = false
+  b.data = nil
+
+proc len*(b: LZ4Blocks): int {.inline.} =
+  ## Number of blocks.
+  b.offsets.len
+
+proc blockLen*(b: LZ4Blocks, i: int): int =
+  ## Uncompressed size of block `i`.
+  int(min(LZ4BlockSize.int64, b.uncompressedSize - i.int64 * LZ4BlockSize))
+
+proc decompressBlock*(b: LZ4Blocks, i: int, dst: var openArray[byte]) =
+  ## Decompresses block `i` alone to `dst`, which must hold blockLen(i) bytes.
+  ## Ex:
+  ## var data = newSeq[byte](blocks.blockLen(7))
+  ## blocks.decompressBlock(7, data)
+  let
+    pos = b.offsets[i]
+    prefix = read32(b.data, pos)
+    size = int(prefix and not StoredBlock)
+    len = b.blockLen(i)
+  if dst.len < len: raise newException(IOError, &"block {i} needs {len} bytes")
+  if (prefix and StoredBlock) != 0:
+    if size != len: corrupt()
+    if len > 0: copyMem(dst[0].addr, b.data[pos + 4].addr, len)
+  elif lz4DecompressBlock(toOpenArray(b.data, pos + 4, pos + 3 + size), toOpenArray(dst, 0, len - 1)) != len:
+    corrupt()
+
+proc decompressBlockJob(job: ptr BlockJob, i, worker: int) {.nimcall, gcsafe.} =
+  let b = job.first + i
+  try:
+    job.blocks[].decompressBlock(b, toOpenArray(job.dst, i * LZ4BlockSize, i * LZ4BlockSize + job.blocks[].blockLen(b) - 1))
+  except IOError as e:
+    job.errors[i] = &"block {b}: {e.msg}"
+
+proc decompressBlocks(job: var BlockJob, n, workers: int) =
+  job.errors = newSeq[string](n)
+  parallelFor(job.addr, n, decompressBlockJob, workers)
+  for e in job.errors:
+    if e.len > 0: raise newException(IOError, e)
+
+proc decompressBuffer*(src: openArray[byte], workers = 0): seq[byte] =
+  ## Decompresses an LZ4BLOC buffer, on `workers` threads. Raises IOError if it is malformed.
+  var blocks = initLZ4Blocks(bytes(src), src.len)
+  result = newSeq[byte](int(blocks.uncompressedSize))
+  var job = BlockJob(blocks: blocks.addr, dst: bytes(result))
+  decompressBlocks(job, blocks.len, workers)
+
+# --- Files ---------------------------------------------------------------------------------------
+
+proc batchBlocks(workers: int): int =
+  # Blocks in flight at once: enough to keep the workers busy, little enough to bound memory.
+  4 * workerCount(workers)
+
+proc compressFile*(src, dst: string, workers = 0): int64 =
+  ## Compresses the file `src` to `dst` a batch of blocks at a time. Returns the compressed size.
+  let size = getFileSize(src)
+  var mem: MemFile
+  if size > 0: mem = memfiles.open(src)
+  defer:
+    if size > 0: mem.close()
+  var f = open(dst, fmWrite)
+  defer: f.close()
+  var h = header(size)
+  if f.writeBuffer(h.addr, sizeof(h)) != sizeof(h):
+    raise newException(IOError, &"failed writing {dst}")
+  result = sizeof(h)
+  let n = blockCount(size)
+  var job = BlockJob(src: cast[Bytes](mem.mem), srcLen: int(size))
+  for first in countup(0, n - 1, batchBlocks(workers)):
+    let count = min(batchBlocks(workers), n - first)
+    job.first = first
+    job.outs.setLen(count)
+    parallelFor(job.addr, count, compressBlock, workers)
+    for o in job.outs:
+      if f.writeBuffer(o[0].unsafeAddr, o.len) != o.len:
+        raise newException(IOError, &"failed writing {dst}")
+      result += o.len
+
+proc decompressFile*(src, dst: string, workers = 0): int64 =
+  ## Decompresses the LZ4BLOC file `src` to `dst` a batch of blocks at a time. Returns the
+  ## decompressed size.
+  var blocks = openLZ4Blocks(src)
+  defer: blocks.close()
+  var f = open(dst, fmWrite)
+  defer: f.close()
+  let batch = batchBlocks(workers)
+  var buffer = newSeq[byte](int(min(batch.int64 * LZ4BlockSize, blocks.uncompressedSize)))
+  var job = BlockJob(blocks: blocks.addr, dst: bytes(buffer))
+  for first in countup(0, blocks.len - 1, batch):
+    let count = min(batch, blocks.len - first)
+    job.first = first
+    decompressBlocks(job, count, workers)
+    var len = 0
+    for b in first ..< first + count: len += blocks.blockLen(b)
+    if f.writeBuffer(buffer[0].addr, len) != len:
+      raise newException(IOError, &"failed writing {dst}")
+  blocks.uncompressedSize
+
+when isMainModule:
+  let args = commandLineParams()
+  if args.len != 3 or args[0] notin ["compress", "decompress"]:
+    quit "usage: buffer_compression compress|decompress <input> <output>"
+  let start = getMonoTime()
+  let inSize = getFileSize(args[1])
+  let outSize = if args[0] == "compress": compressFile(args[1], args[2]) else: decompressFile(args[1], args[2])
+  let ms = max(1, (getMonoTime() - start).inMilliseconds)
+  let raw = if args[0] == "compress": inSize else: outSize
+  echo &"{args[0]}ed {inSize} -> {outSize} bytes ({outSize.float / max(1, inSize).float * 100:.1f}%) in {ms} ms, {raw.float / 1e6 / (ms.float / 1e3):.0f} MB/s"
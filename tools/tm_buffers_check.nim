@@ -0,0 +1,215 @@
+# Integrity and duplicate checker for the buffers of a project (`<asset>.tm_buffers/<hash>`). Every
+# buffer is hashed in parallel with murmurHash64A, the hash The Machinery names buffers by, and
+# checked against its file name. Identical buffers stored by several assets are reported with the
+# bytes they waste, and can be hardlinked together or moved into a shared store.
+# Run with `nimble checkbuffers -- [project dir] [--link | --store:dir]`.
+import std / [os, memfiles, tables, sets, algorithm, strformat, strutils, parseopt, monotimes, times]
+import "../tm/foundation/murmur2"
+import tm_text, tm_project, work_pool
+
+type
+  BufferFile* = object
+    path*: string # project-relative
+    asset*: string # project-relative asset owning the buffer, "" if there is none
+    size*: int64
+    hash*: uint64 # of the content
+    named*: uint64 # hash in the file name, 0 if the name isn't a hash
+    id: tuple[device: DeviceId, file: FileId] # copies that are already hardlinks share it
+    error*: string
+
+  BufferReport* = object
+    buffers*: seq[BufferFile]
+    mismatched*: seq[int] # content doesn't match the name
+    duplicates*: seq[seq[int]] # groups of identical buffers, the first of each is kept
+    wastedBytes*: int64 # stored more than once, not counting copies that are already hardlinks
+    missing*: seq[(string, uint64)] # (asset, hash) of buffer properties without a buffer file
+    orphans*: seq[int] # buffers their asset doesn't mention
+
+  CheckJob = object
+    dir: string
+    buffers: seq[BufferFile]
+    assets: seq[string]
+    bufferKeys: HashSet[string] # names of buffer properties in the type index
+    mentioned: seq[HashSet[uint64]] # hashes in each asset
+    missing: seq[seq[uint64]] # hashes of buffer properties in each asset
+
+proc hashBuffer(job: ptr CheckJob, i, worker: int) {.nimcall, gcsafe.} =
+  let b = job.buffers[i].addr
+  try:
+    let path = job.dir / b.path
+    b.id = getFileInfo(path).id
+    b.size = getFileSize(path)
+    if b.size == 0:
+      b.hash = murmurHash64A(nil, 0)
+      return
+    var m = memfiles.open(path)
+    b.hash = murmurHash64A(cast[ptr uint8](m.mem), m.size)
+    m.close()
+  except CatchableError as e:
+    b.error = e.msg
+
+proc scanAsset(job: ptr CheckJob, i, worker: int) {.nimcall, gcsafe.} =
+  # Hash-like strings the asset mentions; those under buffer properties must have a buffer file.
+  var
+    f: TextFile
+    tok: Token
+    key: TextSlice
+  defer: f.close()
+  try:
+    f = openTextFile(job.dir / job.assets[i])
+    var t = initTextTokenizer(f)
+    while t.next(tok):
+      if tok.kind == tkKey:
+        key = tok.text
+        continue
+      if tok.kind == tkString and not tok.escaped:
+        let (ok, h) = parseHash(tok.text.toOpenArray)
+        if ok:
+          job.mentioned[i].incl h
+          if $key in job.bufferKeys: job.missing[i].add h
+      key = TextSlice()
+  except CatchableError:
+    discard # unreadable assets are other tools' business, their buffers show up as orphans
+
+proc bufferProperties(dir: string): HashSet[string] =
+  let path = dir / TypeIndexFile
+  if not fileExists(path): return
+  var f = openTextFile(path)
+  defer: f.close()
+  let tree = parseTree(f)
+  if tree.nodes.len == 0: return
+  for t in tree.children(0):
+    let props = tree.child(t, "properties")
+    if props < 0: continue
+    for p in tree.children(props):
+      let typ = tree.child(p, "type")
+      if typ >= 0 and tree[typ].text == "buffer":
+        let name = tree.child(p, "name")
+        if name >= 0: result.incl tree.str(name)
+
+proc checkBuffers*(dir: string, workers = 0): BufferReport =
+  ## Hashes every buffer of the project in `dir` and cross-checks them with their assets.
+  var job = CheckJob(dir: dir, bufferKeys: bufferProperties(dir))
+  var assetOf: Table[string, string] # "core/camera" -> "core/camera.tm_entity"
+  for a in projectFiles(dir):
+    job.assets.add a
+    assetOf[a.changeFileExt("")] = a
+  for path in walkDirRec(dir, relative = true):
+    let p = path.replace('\\', '/')
+    let owner = p.parentDir.replace('\\', '/')
+    if not owner.endsWith(BuffersExt): continue
+    let (ok, named) = parseHash(p.extractFilename)
+    job.buffers.add BufferFile(path: p, asset: assetOf.getOrDefault(owner.changeFileExt("")),
+      named: if ok: named else: 0)
+  job.buffers.sort(proc (a, b: BufferFile): int = cmp(a.path, b.path))
+  job.mentioned.setLen(job.assets.len)
+  job.missing.setLen(job.assets.len)
+  parallelFor(job.addr, job.buffers.len, hashBuffer, workers)
+  parallelFor(job.addr, job.assets.len, scanAsset, workers)
+
+  var
+    groups: Table[(uint64, int64), seq[int]]
+    stored: Table[string, HashSet[uint64]] # buffer hashes present per asset
+  for i, b in job.buffers:
+    if b.error.len > 0: continue
+    if b.named != b.hash:
+      result.mismatched.add i
+      continue
+    groups.mgetOrPut((b.hash, b.size), @[]).add i
+    stored.mgetOrPut(b.asset, initHashSet[uint64]()).incl b.hash
+  for g in groups.values:
+    if g.len < 2: continue
+    result.duplicates.add g
+    var ids: HashSet[tuple[device: DeviceId, file: FileId]]
+    for i in g: ids.incl job.buffers[i].id
+    result.wastedBytes += job.buffers[g[0]].size * (ids.len - 1)
+  result.duplicates.sort(proc (a, b: seq[int]): int = cmp(job.buffers[b[0]].size * b.len, job.buffers[a[0]].size * a.len))
+
+  var assetIndex: Table[string, int]
+  for i, a in job.assets: assetIndex[a] = i
+  for i, b in job.buffers:
+    let a = assetIndex.getOrDefault(b.asset, -1)
+    if b.error.len == 0 and (a < 0 or b.named notin job.mentioned[a]): result.orphans.add i
+  for i, a in job.assets:
+    let have = stored.getOrDefault(a)
+    for h in job.missing[i]:
+      if h notin have: result.missing.add (a, h)
+  result.buffers = move job.buffers
+
+proc replaceWithLink(target, path: string) =
+  # Hardlinks `path` to `target` without a window where `path` doesn't exist.
+  let tmp = path & ".tmlink"
+  createHardlink(target, tmp)
+  moveFile(tmp, path)
+
+proc linkDuplicates*(r: BufferReport, dir: string): int64 =
+  ## Replaces every duplicate with a hardlink to the first buffer of its group. Returns the bytes
+  ## freed.
+  for g in r.duplicates:
+    let keep = r.buffers[g[0]]
+    var ids = toHashSet([keep.id])
+    for i in g[1 .. ^1]:
+      let b = r.buffers[i]
+      if b.id == keep.id: continue
+      replaceWithLink(dir / keep.path, dir / b.path)
+      if not ids.containsOrIncl(b.id): result += keep.size # copies linked to each other free it once
+
+proc storeDuplicates*(r: BufferReport, dir, store: string): int64 =
+  ## Moves one copy of every duplicated buffer to `store/<hash>` and hardlinks all the copies to
+  ## it, so the store holds the only data. `store` has to be on the same file system as `dir`.
+  ## Returns the bytes freed.
+  createDir(store)
+  for g in r.duplicates:
+    let
+      first = r.buffers[g[0]]
+      shared = store / hashString(first.hash)
+    if not fileExists(shared): createHardlink(dir / first.path, shared)
+    let sharedId = getFileInfo(shared).id
+    var ids: HashSet[tuple[device: DeviceId, file: FileId]]
+    for i in g:
+      let b = r.buffers[i]
+      if b.id != sharedId:
+        if b.id notin ids and b.id != first.id: result += b.size
+        replaceWithLink(shared, dir / b.path)
+      ids.incl b.id
+
+when isMainModule:
+  var
+    dir = "tm_proj"
+    link = false
+    store = ""
+  for kind, key, val in getopt():
+    case kind
+    of cmdArgument: dir = key
+    of cmdLongOption, cmdShortOption:
+      case key
+      of "link": link = true
+      of "store": store = val
+      else: quit &"unknown option --{key}"
+    of cmdEnd: discard
+
+  let start = getMonoTime()
+  let r = checkBuffers(dir)
+  var total: int64
+  for b in r.buffers: total += b.size
+  echo &"{r.buffers.len} buffers, {total} bytes, hashed in {(getMonoTime() - start).inMilliseconds} ms"
+  for b in r.buffers:
+    if b.error.len > 0: echo &"error: {b.path}: {b.error}"
+  for i in r.mismatched:
+    let b = r.buffers[i]
+    echo &"corrupt: {b.path} hashes to {hashString(b.hash)}"
+  for (asset, h) in r.missing:
+    echo &"missing: {asset} uses buffer {hashString(h)}"
+  for i in r.orphans:
+    echo &"orphan: {r.buffers[i].path}"
+  for g in r.duplicates:
+    let b = r.buffers[g[0]]
+    echo &"duplicate: {hashString(b.hash)} ({b.size} bytes) x{g.len}"
+    for i in g: echo &"  {r.buffers[i].path}"
+  echo &"{r.duplicates.len} duplicated buffers, {r.wastedBytes} bytes wasted"
+
+  if link:
+    echo &"hardlinked duplicates, {r.linkDuplicates(dir)} bytes freed"
+  elif store.len > 0:
+    echo &"moved duplicates to {store}, {r.storeDuplicates(dir, store)} bytes freed"
+  if r.mismatched.len > 0 or r.missing.len > 0: quit(1)
@@ -0,0 +1,344 @@
+# Dry run of pending Truth migrations over a project. Compares the migration IDs the project has
+# applied (`__migration_index.tm_meta`, what `tm_the_truth_api.migration_ids` returns once it is
+# loaded) with the ones an engine version registers, and lists the assets the pending ones would
+# rewrite by the `__type`s they migrate, with object counts and the bytes rewritten. Subobjects
+# that leave out `__type` get the one their property implies in the type index. Objects whose type
+# can't be told (the property takes any type, or the project has no type index) are counted as
+# untyped: any migration may touch them, the plan reports them but doesn't charge them to one.
+# Assets are scanned in parallel and each file's types are cached by mtime and size, so repeat runs
+# only rescan changed files.
+# Run with `nimble migrationplan -- <project dir> <migrations file> [--cache:file] [--workers:n] [--json]`.
+#
+# The migrations file lists the engine's migrations in the text format, by name or by ID, with the
+# types each one migrates. Leave out `types` for migrations that may touch any type:
+# [
+# 	{
+# 		name: "my_component_v2"
+# 		types: [ "my_component" ]
+# 	}
+# 	{
+# 		id: "2f7f2954d037caba"
+# 	}
+# ]
+import std / [os, tables, sets, algorithm, strformat, strutils, json, parseopt, monotimes, times]
+import "../tm/foundation/murmur2"
+import tm_snapshot, work_pool
+
+const CacheMagic = "TMTYPES2"
+
+type
+  Migration* = object
+    id*: uint64
+    name*: string # empty if the migrations file only has the ID
+    types*: seq[string] # empty if it may touch any type
+
+  FileTypes* = object
+    path*: string # project-relative
+    mtime*, size*: int64
+    types*: seq[(string, int)] # objects per type, sorted by name
+    untyped*: int # objects whose type isn't known
+
+  MigrationImpact* = object
+    migration*: Migration
+    files*, objects*: int
+    bytes*: int64 # size of the files it touches, they are rewritten whole
+
+  MigrationPlan* = object
+    applied*: int
+    unknown*: seq[uint64] # applied IDs the migrations file doesn't list
+    pending*: seq[MigrationImpact]
+    files*: seq[string] # assets any pending migration touches
+    bytes*: int64 # their size
+    untyped*, untypedFiles*: int # objects without a known type and the assets holding them
+    assets*, scanned*, cached*: int
+
+  ScanJob = object
+    dir: string
+    types: ptr TypeIndex
+    files: seq[FileTypes]
+    errors: seq[string]
+
+proc label*(m: Migration): string =
+  if m.name.len > 0: m.name else: hashString(m.id)
+
+# --- Migration IDs -------------------------------------------------------------------------------
+
+proc readHash(tree: TextTree, i: int32, path: string): uint64 =
+  let (ok, h) = parseHash(tree[i].text.toOpenArray)
+  if tree[i].kind != nkString or not ok: raise newException(IOError, &"{path}: expected a hash, got {tree[i].text}")
+  h
+
+proc readMigrationIndex*(dir: string): seq[uint64] =
+  ## IDs of the migrations applied to the project in `dir`, none if it has no migration index.
+  let path = dir / MigrationIndexFile
+  if not fileExists(path): return
+  var f = openTextFile(path)
+  defer: f.close()
+  let tree = parseTree(f)
+  if tree.nodes.len == 0 or tree[0].kind != nkArray: raise newException(IOError, &"{path}: not a migration index")
+  for i in tree.children(0): result.add readHash(tree, i, path)
+
+proc readMigrations*(path: string): seq[Migration] =
+  ## The migrations listed in `path`. Raises IOError if it isn't a migrations file.
+  var f = openTextFile(path)
+  defer: f.close()
+  let tree = parseTree(f)
+  if tree.nodes.len == 0 or tree[0].kind != nkArray: raise newException(IOError, &"{path}: not a migrations file")
+  for i in tree.children(0):
+    let (name, id, types) = (tree.child(i, "name"), tree.child(i, "id"), tree.child(i, "types"))
+    var m: Migration
+    if name >= 0:
+      m.name = tree.str(name)
+      m.id = murmurHash64A(m.name)
+    elif id >= 0:
+      m.id = readHash(tree, id, path)
+    else:
+      raise newException(IOError, &"{path}: migration without a name or id")
+    if types >= 0:
+      for t in tree.children(types): m.types.add tree.str(t)
+    result.add m
+
+# --- Scanning ------------------------------------------------------------------------------------
+
+proc count(types: var seq[(string, int)], name: TextSlice | string) =
+  # Files use a handful of types, a linear search beats hashing.
+  for t in types.mitems:
+    if name == t[0]:
+      inc t[1]
+      return
+  types.add ($name, 1)
+
+type OpenObject = object
+  typ: int32 # in the type index, -1 if it isn't known or isn't in it
+  name: TextSlice # `__type` or `__prototype_type` if it isn't in the type index
+  own: bool # `__type` was set, `__prototype_type` doesn't override it
+
+proc setType(o: var OpenObject, ti: TypeIndex, name: TextSlice, own: bool) =
+  o.typ = ti.find(name)
+  o.name = if o.typ < 0: name else: TextSlice()
+  o.own = own
+
+proc scanTypes(path: string, ti: TypeIndex, ft: var FileTypes) =
+  # Objects per type: `__type`, else `__prototype_type` for objects that inherit it, else the type
+  # the owner's property implies.
+  var f = openTextFile(path)
+  defer: f.close()
+  var
+    t = initTextTokenizer(f)
+    tok: Token
+    key: TextSlice
+    open: seq[OpenObject]
+    arrays: seq[TextSlice] # property of each open container, empty for objects
+  while t.next(tok):
+    case tok.kind
+    of tkKey:
+      key = tok.text
+      continue
+    of tkArrayBegin: arrays.add key
+    of tkArrayEnd: arrays.setLen(max(0, arrays.len - 1))
+    of tkObjectBegin:
+      let property = if key.len > 0 or arrays.len == 0: key else: arrays[^1] # set items have no key
+      let owner = if open.len > 0: open[^1].typ else: -1'i32
+      open.add OpenObject(typ: ti.childType(owner, property))
+      arrays.add TextSlice()
+    of tkObjectEnd:
+      if open.len == 0: continue
+      let o = open.pop()
+      arrays.setLen(max(0, arrays.len - 1))
+      if o.typ >= 0: ft.types.count(ti.names[o.typ])
+      elif o.name.len > 0: ft.types.count(o.name)
+      else: inc ft.untyped
+    of tkString:
+      if open.len == 0: discard
+      elif key == "__type": open[^1].setType(ti, tok.text, true)
+      elif key == "__prototype_type" and not open[^1].own: open[^1].setType(ti, tok.text, false)
+    else: discard
+    key = TextSlice()
+  ft.types.sort(proc (a, b: (string, int)): int = cmp(a[0], b[0]))
+
+proc scanOne(job: ptr ScanJob, i, worker: int) {.nimcall, gcsafe.} =
+  try:
+    scanTypes(job.dir / job.files[i].path, job.types[], job.files[i])
+  except CatchableError as e:
+    job.errors[i] = e.msg
+
+# --- Cache ---------------------------------------------------------------------------------------
+
+proc put[T: SomeInteger](s: var string, x: T) =
+  let old = s.len
+  s.setLen(old + sizeof(T))
+  copyMem(s[old].addr, x.unsafeAddr, sizeof(T))
+
+proc put(s: var string, str: string) =
+  s.put(str.len.uint32)
+  s.add str
+
+proc get[T: SomeInteger](s: string, pos: var int, x: var T) =
+  if pos + sizeof(T) > s.len: raise newException(IOError, "truncated type cache")
+  copyMem(x.addr, s[pos].unsafeAddr, sizeof(T))
+  pos += sizeof(T)
+
+proc get(s: string, pos: var int, str: var string) =
+  var n: uint32
+  s.get(pos, n)
+  if pos + n.int > s.len: raise newException(IOError, "truncated type cache")
+  str = s[pos ..< pos + n.int]
+  pos += n.int
+
+proc readTypeCache*(path: string, typeIndexHash: uint64): Table[string, FileTypes] =
+  ## Types per file from the cache at `path`, none if it is missing, not a type cache or was made
+  ## with another type index.
+  if not fileExists(path): return
+  let s = readFile(path)
+  if not s.startsWith(CacheMagic): return
+  var pos = CacheMagic.len
+  try:
+    var h: uint64
+    s.get(pos, h)
+    if h != typeIndexHash: return
+    while pos < s.len:
+      var
+        ft: FileTypes
+        n: uint32
+      s.get(pos, ft.path)
+      s.get(pos, ft.mtime)
+      s.get(pos, ft.size)
+      s.get(pos, ft.untyped)
+      s.get(pos, n)
+      ft.types.setLen(n.int)
+      for t in ft.types.mitems:
+        var c: uint32
+        s.get(pos, t[0])
+        s.get(pos, c)
+        t[1] = c.int
+      result[ft.path] = ft
+  except IOError:
+    result.clear()
+
+proc writeTypeCache*(path: string, typeIndexHash: uint64, files: openArray[FileTypes]) =
+  var s = CacheMagic
+  s.put(typeIndexHash)
+  for ft in files:
+    s.put(ft.path)
+    s.put(ft.mtime)
+    s.put(ft.size)
+    s.put(ft.untyped)
+    s.put(ft.types.len.uint32)
+    for (name, n) in ft.types:
+      s.put(name)
+      s.put(n.uint32)
+  writeFile(path & ".tmp", s)
+  moveFile(path & ".tmp", path)
+
+proc projectTypes*(dir, cachePath: string, plan: var MigrationPlan, workers = 0): seq[FileTypes] =
+  ## Types of every asset in `dir`, rescanning only files whose mtime or size differs from the
+  ## cache at `cachePath`, which is then updated.
+  var types = loadTypeIndex(dir / TypeIndexFile)
+  let cache = readTypeCache(cachePath, types.hash)
+  var
+    job = ScanJob(dir: dir, types: types.addr)
+    slots: seq[int] # result index of each scanned file
+  for rel in projectFiles(dir):
+    let path = dir / rel
+    let ft = FileTypes(path: rel, mtime: mtimeOf(path), size: getFileSize(path))
+    let old = cache.getOrDefault(rel)
+    if old.path.len > 0 and old.mtime == ft.mtime and old.size == ft.size:
+      result.add old
+    else:
+      slots.add result.len
+      job.files.add ft
+      result.add ft
+  job.errors.setLen(job.files.len)
+  parallelFor(job.addr, job.files.len, scanOne, workers)
+  for i, e in job.errors:
+    if e.len > 0: raise newException(IOError, e)
+    result[slots[i]] = job.files[i]
+  plan.assets = result.len
+  plan.scanned = job.files.len
+  plan.cached = result.len - job.files.len
+  writeTypeCache(cachePath, types.hash, result)
+
+# --- Plan ----------------------------------------------------------------------------------------
+
+proc planMigrations*(dir, migrationsPath, cachePath: string, workers = 0): MigrationPlan =
+  ## What the migrations in `migrationsPath` that the project in `dir` hasn't applied would rewrite.
+  let
+    applied = readMigrationIndex(dir)
+    migrations = readMigrations(migrationsPath)
+    appliedSet = applied.toHashSet
+  result.applied = applied.len
+  var known: HashSet[uint64]
+  for m in migrations:
+    known.incl m.id
+    if m.id notin appliedSet: result.pending.add MigrationImpact(migration: m)
+  for id in applied:
+    if id notin known: result.unknown.add id
+  if result.pending.len == 0: return
+
+  let files = projectTypes(dir, cachePath, result, workers)
+  var touched = newSeq[bool](files.len)
+  for p in result.pending.mitems:
+    let types = p.migration.types.toHashSet
+    for i, ft in files:
+      var objects = 0
+      for (name, n) in ft.types:
+        if types.len == 0 or name in types: objects += n
+      if objects == 0: continue
+      inc p.files
+      p.objects += objects
+      p.bytes += ft.size
+      touched[i] = true
+  for i, ft in files:
+    if touched[i]:
+      result.files.add ft.path
+      result.bytes += ft.size
+    if ft.untyped > 0:
+      result.untyped += ft.untyped
+      inc result.untypedFiles
+
+proc toJson*(p: MigrationPlan): JsonNode =
+  var pending = newJArray()
+  for m in p.pending:
+    pending.add %*{"id": hashString(m.migration.id), "name": m.migration.name, "types": m.migration.types,
+      "files": m.files, "objects": m.objects, "bytes": m.bytes}
+  var unknown = newJArray()
+  for id in p.unknown: unknown.add %hashString(id)
+  %*{
+    "applied": p.applied, "unknown": unknown, "pending": pending, "files": p.files, "bytes": p.bytes,
+    "untyped": p.untyped, "untyped_files": p.untypedFiles, "assets": p.assets, "scanned": p.scanned,
+    "cached": p.cached
+  }
+
+when isMainModule:
+  var
+    args: seq[string]
+    cachePath = ""
+    workers = 0
+    asJson = false
+  for kind, key, val in getopt():
+    case kind
+    of cmdArgument: args.add key
+    else:
+      case key
+      of "cache": cachePath = val
+      of "workers": workers = parseInt(val)
+      of "json": asJson = true
+      else: quit &"unknown option {key}"
+  if args.len != 2:
+    quit "usage: tm_migration_plan <project dir> <migrations file> [--cache:file] [--workers:n] [--json]"
+  if cachePath.len == 0: cachePath = args[0].normalizedPath & ".tm_type_cache"
+
+  let start = getMonoTime()
+  let plan = planMigrations(args[0], args[1], cachePath, workers)
+  if asJson:
+    echo plan.toJson.pretty
+    quit(0)
+  echo &"{plan.applied} migrations applied, {plan.pending.len} pending"
+  for id in plan.unknown: echo &"  applied but not in {args[1]}: {hashString(id)}"
+  for m in plan.pending:
+    echo &"  {m.migration.label}: {m.files} files, {m.objects} objects, {m.bytes} bytes"
+  if plan.untyped > 0:
+    echo &"  {plan.untyped} objects in {plan.untypedFiles} assets have no known type, any migration may touch them"
+  if plan.pending.len > 0:
+    echo &"{plan.files.len} of {plan.assets} assets to rewrite, {plan.bytes} bytes; {plan.scanned} scanned, " &
+      &"{plan.cached} cached, in {(getMonoTime() - start).inMilliseconds} ms"
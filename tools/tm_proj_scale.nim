@@ -0,0 +1,158 @@
+# Synthetic projects for load-time benchmarks: copies a project (tm_proj by default) and adds clones
+# of all its assets under `clones/<n>/` until it has the requested number of assets. Every UUID the
+# project defines is remapped the same way within a clone, so prototypes and references resolve
+# inside the clone, while references to objects outside the project are kept. Buffers are
+# hardlinked; they are named by their content, which doesn't change.
+# Run with `nimble scaleproject -- <project dir> <output dir> <number of assets>`.
+import std / [os, sets, strformat, strutils, monotimes, times]
+import tm_text, tm_project, work_pool
+
+const ScaleInfoFile* = "__scale_info.tm_meta" # marks a generated project and what it was made from
+
+type
+  ScaleStats* = object
+    assets*, clones*, files*: int
+    bytes*: int64 # text written, buffers are links
+    reused*: bool # the output already was this project
+
+  ScaleJob = object
+    src, dst: string
+    assets, buffers: seq[string] # project-relative
+    defined: HashSet[Uuid]
+    bytes: seq[int64] # per clone
+    errors: seq[string] # per clone
+
+proc splitMix(x: uint64): uint64 =
+  result = x + 0x9E3779B97F4A7C15'u64
+  result = (result xor (result shr 30)) * 0xBF58476D1CE4E5B9'u64
+  result = (result xor (result shr 27)) * 0x94D049BB133111EB'u64
+  result = result xor (result shr 31)
+
+proc definedUuids*(dir: string, assets: openArray[string]): HashSet[Uuid] =
+  ## The `__uuid` of every object in `assets`.
+  var tok: Token
+  for rel in assets:
+    var f = openTextFile(dir / rel)
+    try:
+      var
+        t = initTextTokenizer(f)
+        key: TextSlice
+      while t.next(tok):
+        if tok.kind == tkKey:
+          key = tok.text
+          continue
+        if tok.kind == tkUuid and key == "__uuid": result.incl tok.uuid
+        key = TextSlice()
+    finally:
+      f.close()
+
+proc addSlice(dst: var string, s: TextSlice, a, b: int) =
+  # s[a ..< b]
+  let n = b - a
+  if n <= 0: return
+  let old = dst.len
+  dst.setLen(old + n)
+  copyMem(dst[old].addr, s.p[a].addr, n)
+
+proc cloneText(f: TextFile, defined: HashSet[Uuid], salt: Uuid, dst: var string) =
+  # The file with every UUID the project defines xor'ed with `salt`, the rest byte for byte.
+  dst.setLen(0)
+  var
+    t = initTextTokenizer(f)
+    tok: Token
+    pos = 0
+  while t.next(tok):
+    if tok.kind != tkUuid or tok.uuid notin defined: continue
+    let start = cast[int](tok.text.p) - cast[int](f.data.p)
+    dst.addSlice(f.data, pos, start)
+    dst.add $Uuid(a: tok.uuid.a xor salt.a, b: tok.uuid.b xor salt.b)
+    pos = start + tok.text.len
+  dst.addSlice(f.data, pos, f.data.len)
+
+proc linkOrCopy(src, dst: string) =
+  try: createHardlink(src, dst)
+  except OSError: copyFile(src, dst)
+
+proc cloneProject(job: ptr ScaleJob, i, worker: int) {.nimcall, gcsafe.} =
+  # Clone `i + 1`, clone 0 is the copy of the project itself.
+  let
+    k = uint64(i + 1)
+    salt = Uuid(a: splitMix(k), b: splitMix(not k))
+    root = job.dst / "clones" / $(i + 1)
+  var text: string
+  try:
+    for rel in job.assets:
+      var f = openTextFile(job.src / rel)
+      try:
+        cloneText(f, job.defined, salt, text)
+      finally:
+        f.close()
+      createDir(parentDir(root / rel))
+      writeFile(root / rel, text)
+      job.bytes[i] += text.len
+    for rel in job.buffers:
+      createDir(parentDir(root / rel))
+      linkOrCopy(job.src / rel, root / rel)
+  except CatchableError as e:
+    job.errors[i] = e.msg
+
+proc scaleProject*(src, dst: string, assets: int, workers = 0): ScaleStats =
+  ## Writes a project with at least `assets` assets to `dst`: the one in `src` plus as many clones as
+  ## needed. Does nothing if `dst` already is that project. Raises IOError if `dst` is something else.
+  let source = src.absolutePath.replace('\\', '/')
+  let info = &"source: \"{source}\"\nassets: {assets}\n"
+  if dirExists(dst):
+    if fileExists(dst / ScaleInfoFile) and readFile(dst / ScaleInfoFile) == info:
+      result.reused = true
+      result.assets = projectFiles(dst).len
+      return
+    raise newException(IOError, &"{dst} exists and isn't a scaled copy of {src} with {assets} assets")
+
+  # Generated next to `dst` and renamed when done, so a failed or interrupted run doesn't leave a
+  # half project behind that later runs refuse to reuse.
+  let tmp = dst & ".tmp"
+  if dirExists(tmp): removeDir(tmp)
+  var job = ScaleJob(src: src, dst: tmp, assets: projectFiles(src))
+  if job.assets.len == 0: raise newException(IOError, &"{src} has no assets")
+  for path in walkDirRec(src, relative = true):
+    let p = path.replace('\\', '/')
+    if (BuffersExt & "/") in p: job.buffers.add p
+  job.defined = definedUuids(src, job.assets)
+
+  try:
+    createDir(tmp)
+    for path in walkDirRec(src, relative = true):
+      createDir(parentDir(tmp / path))
+      if (BuffersExt & "/") in path.replace('\\', '/'):
+        linkOrCopy(src / path, tmp / path)
+      else:
+        copyFile(src / path, tmp / path)
+        result.bytes += getFileSize(src / path)
+
+    let clones = max(0, (assets + job.assets.len - 1) div job.assets.len - 1)
+    job.bytes.setLen(clones)
+    job.errors.setLen(clones)
+    parallelFor(job.addr, clones, cloneProject, workers)
+    for e in job.errors:
+      if e.len > 0: raise newException(IOError, e)
+    for b in job.bytes: result.bytes += b
+    writeFile(tmp / ScaleInfoFile, info)
+    result.clones = clones
+  except CatchableError:
+    removeDir(tmp)
+    raise
+  moveDir(tmp, dst)
+  result.assets = job.assets.len * (result.clones + 1)
+  result.files = result.assets + job.buffers.len * (result.clones + 1)
+
+when isMainModule:
+  let args = commandLineParams()
+  if args.len != 3:
+    quit "usage: tm_proj_scale <project dir> <output dir> <number of assets>"
+  let start = getMonoTime()
+  let stats = scaleProject(args[0], args[1], parseInt(args[2]))
+  if stats.reused:
+    echo &"{args[1]}: already generated, {stats.assets} assets"
+  else:
+    echo &"{args[1]}: {stats.assets} assets ({stats.clones} clones), {stats.files} files, " &
+      &"{stats.bytes} bytes of text in {(getMonoTime() - start).inMilliseconds} ms"
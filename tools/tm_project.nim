@@ -0,0 +1,26 @@
+# Layout of a project directory as saved by The Machinery: text assets (`*.tm_entity`,
+# `*.tm_creation`, `*.tm_dir`, ...), their buffers in `<asset>.tm_buffers/<hash>` and the
+# `__*_index.tm_meta` indexes at the root.
+import std / [os, strutils, algorithm, times]
+
+const
+  TypeIndexFile* = "__type_index.tm_meta"
+  MigrationIndexFile* = "__migration_index.tm_meta"
+  BuffersExt* = ".tm_buffers"
+
+proc isAssetFile*(relPath: string): bool =
+  ## Text asset files: `*.tm_<kind>` outside `.tm_buffers` directories, except the `.tm_meta` indexes.
+  let ext = relPath.splitFile.ext
+  ext.startsWith(".tm_") and ext notin [".tm_meta", BuffersExt] and (BuffersExt & "/") notin relPath
+
+proc projectFiles*(dir: string): seq[string] =
+  ## Project-relative paths of the asset files in `dir`, with '/' separators, sorted.
+  for path in walkDirRec(dir, relative = true):
+    let p = path.replace('\\', '/')
+    if p.isAssetFile: result.add p
+  result.sort()
+
+proc mtimeOf*(path: string): int64 =
+  ## Modification time in nanoseconds since the epoch.
+  let t = getLastModificationTime(path)
+  t.toUnix * 1_000_000_000 + t.nanosecond
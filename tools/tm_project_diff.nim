@@ -0,0 +1,244 @@
+# Object-level diff of two versions of a project, matching objects by `__uuid` instead of by line,
+# so CI can validate, bake or upload only what changed. Both sides are read from snapshots
+# (tm_snapshot): files whose content hash matches are skipped outright, and within changed files
+# every object gets a hash of its whole subtree, so unchanged subtrees are skipped without
+# comparing them. Objects that moved to another file or parent are matched all the same.
+# Run with `nimble projectdiff -- <old project or snapshot> <new project or snapshot> [--json]`.
+import std / [os, tables, hashes, json, strformat, strutils, sequtils, monotimes, times]
+import "../tm/foundation/murmur2"
+import tm_snapshot
+
+type
+  ChangeKind* = enum
+    ckAdded, ckRemoved, ckModified
+
+  PropertyChange* = object
+    key*: string
+    kind*: ChangeKind
+
+  ObjectChange* = object
+    kind*: ChangeKind
+    uuid*: Uuid # zero for the root of a file without one
+    typeName*: string
+    path*: string # file in the new project, in the old one for removed objects
+    subobjects*: int # added or removed objects with a uuid inside this one, not listed on their own
+    properties*: seq[PropertyChange] # ckModified only
+
+  ProjectDiff* = object
+    addedFiles*, removedFiles*, changedFiles*: seq[string]
+    unchangedFiles*: int
+    objects*: seq[ObjectChange]
+    compared*: int # objects whose subtree changed and were compared property by property
+    skipped*: int # matched objects whose subtree hash was unchanged
+
+  SectionHashes = object
+    subtree, shallow: seq[uint64] # per object; shallow has subobjects with a uuid by their uuid only
+
+  Side = object
+    snap: Snapshot
+    hashes: seq[SectionHashes] # per file, empty for files that didn't change
+    byUuid: Table[Uuid, (int32, int32)] # objects of changed files -> (file, object)
+
+proc isZero(u: Uuid): bool {.inline.} =
+  u.a == 0 and u.b == 0
+
+proc combine(h, x: uint64): uint64 {.inline.} =
+  ((h shl 5 or h shr 59) xor x) * 0xff51afd7ed558ccd'u64
+
+proc hashStr(s: cstring): uint64 {.inline.} =
+  murmurHash64A(cast[ptr uint8](s), s.len)
+
+proc valueHash(sec: SnapSection, v: ptr SnapValue, h: SectionHashes, deep: bool): uint64 =
+  result = combine(uint64(v.kind), if v.key == NoKey: 0'u64 else: hashStr(sec.str(v.key)))
+  case v.kind
+  of vkNone: discard
+  of vkBool, vkNumber, vkHash: result = combine(result, v.a)
+  of vkUuid: result = combine(combine(result, v.a), v.b)
+  of vkString: result = combine(result, hashStr(sec.str(v.a.uint32)))
+  of vkObject:
+    let c = sec[v.a.int]
+    result = combine(result, if deep or c.uuid.isZero: h.subtree[v.a.int] else: combine(c.uuid.a, c.uuid.b))
+  of vkArray:
+    for item in sec.items(v): result = combine(result, valueHash(sec, item, h, deep))
+
+proc sectionHashes(sec: SnapSection): SectionHashes =
+  # Subobjects always come after their owner, so one backwards pass has every child hashed first.
+  result.subtree.setLen(sec.len)
+  result.shallow.setLen(sec.len)
+  for i in countdown(sec.len - 1, 0):
+    var deep, shallow = uint64(sec[i].numValues)
+    for v in sec.values(sec[i]):
+      deep = combine(deep, valueHash(sec, v, result, true))
+      shallow = combine(shallow, valueHash(sec, v, result, false))
+    result.subtree[i] = deep
+    result.shallow[i] = shallow
+
+proc addChildren(sec: SnapSection, v: ptr SnapValue, dst: var seq[int]) =
+  if v.kind == vkObject: dst.add v.a.int
+  elif v.kind == vkArray:
+    for item in sec.items(v): addChildren(sec, item, dst)
+
+proc children(sec: SnapSection, o: int): seq[int] =
+  for v in sec.values(sec[o]): addChildren(sec, v, result)
+
+proc indexChanged(side: var Side, changed: seq[bool]) =
+  side.hashes.setLen(side.snap.len)
+  for f in 0 ..< side.snap.len:
+    if not changed[f]: continue
+    let sec = side.snap.section(f)
+    side.hashes[f] = sectionHashes(sec)
+    for o in 0 ..< sec.len:
+      if not sec[o].uuid.isZero: side.byUuid[sec[o].uuid] = (f.int32, o.int32)
+
+proc propertyHashes(sec: SnapSection, o: int, h: SectionHashes): OrderedTable[string, uint64] =
+  for v in sec.values(sec[o]):
+    result[$sec.str(v.key)] = valueHash(sec, v, h, false)
+
+proc propertyChanges(old: Side, oldFile, oldObj: int, cur: Side, newFile, newObj: int): seq[PropertyChange] =
+  let
+    before = propertyHashes(old.snap.section(oldFile), oldObj, old.hashes[oldFile])
+    after = propertyHashes(cur.snap.section(newFile), newObj, cur.hashes[newFile])
+  for key, h in after:
+    if key notin before: result.add PropertyChange(key: key, kind: ckAdded)
+    elif before[key] != h: result.add PropertyChange(key: key, kind: ckModified)
+  for key in before.keys:
+    if key notin after: result.add PropertyChange(key: key, kind: ckRemoved)
+
+proc visit(d: var ProjectDiff, old, cur: Side, f, o: int, added: int) =
+  # Object `o` of changed new file `f`. `added` is the change of its closest added ancestor, -1 if
+  # there is none.
+  let
+    sec = cur.snap.section(f)
+    obj = sec[o]
+  var added = added
+  var match = (-1'i32, -1'i32)
+  if not obj.uuid.isZero:
+    match = old.byUuid.getOrDefault(obj.uuid, match)
+  elif o == 0:
+    let oldFile = old.snap.findFile(cur.snap.path(f))
+    if oldFile >= 0 and old.hashes[oldFile].subtree.len > 0: match = (oldFile.int32, 0'i32)
+  if match[0] >= 0:
+    let (mf, mo) = (match[0].int, match[1].int)
+    if old.hashes[mf].subtree[mo] == cur.hashes[f].subtree[o]:
+      inc d.skipped
+      return
+    inc d.compared
+    if old.hashes[mf].shallow[mo] != cur.hashes[f].shallow[o]:
+      d.objects.add ObjectChange(kind: ckModified, uuid: obj.uuid, typeName: cur.snap.typeName(obj.typeIndex),
+        path: cur.snap.path(f), properties: propertyChanges(old, mf, mo, cur, f, o))
+  elif not obj.uuid.isZero:
+    if added >= 0:
+      inc d.objects[added].subobjects
+    else:
+      added = d.objects.len
+      d.objects.add ObjectChange(kind: ckAdded, uuid: obj.uuid, typeName: cur.snap.typeName(obj.typeIndex),
+        path: cur.snap.path(f))
+  for c in sec.children(o): d.visit(old, cur, f, c, added)
+
+proc collectRemoved(d: var ProjectDiff, old, cur: Side) =
+  # Objects of changed old files whose uuid is gone, listed under their topmost removed ancestor.
+  var listed: Table[(int, int), int] # (file, object) -> change
+  for f in 0 ..< old.snap.len:
+    if old.hashes[f].subtree.len == 0: continue
+    let sec = old.snap.section(f)
+    for o in 0 ..< sec.len: # owners come first, so ancestors are listed before their subobjects
+      let u = sec[o].uuid
+      if u.isZero or u in cur.byUuid: continue
+      var p = sec[o].parent.int
+      while p >= 0 and sec[p].uuid.isZero: p = sec[p].parent.int
+      if p >= 0 and (f, p) in listed:
+        inc d.objects[listed[(f, p)]].subobjects
+        listed[(f, o)] = listed[(f, p)]
+      else:
+        listed[(f, o)] = d.objects.len
+        d.objects.add ObjectChange(kind: ckRemoved, uuid: u, typeName: old.snap.typeName(sec[o].typeIndex),
+          path: old.snap.path(f))
+
+proc diffSnapshots*(oldPath, newPath: string): ProjectDiff =
+  ## Object-level changes from the snapshot at `oldPath` to the one at `newPath`.
+  var old = Side(snap: openSnapshot(oldPath))
+  defer: old.snap.close()
+  var cur = Side(snap: openSnapshot(newPath))
+  defer: cur.snap.close()
+
+  # Files are sorted by path on both sides.
+  var
+    oldChanged = newSeq[bool](old.snap.len)
+    newChanged = newSeq[bool](cur.snap.len)
+    i, j = 0
+  while i < old.snap.len or j < cur.snap.len:
+    let c =
+      if i >= old.snap.len: 1
+      elif j >= cur.snap.len: -1
+      else: cmp(old.snap.path(i), cur.snap.path(j))
+    if c < 0:
+      result.removedFiles.add old.snap.path(i)
+      oldChanged[i] = true
+      inc i
+    elif c > 0:
+      result.addedFiles.add cur.snap.path(j)
+      newChanged[j] = true
+      inc j
+    else:
+      if old.snap.file(i).hash == cur.snap.file(j).hash:
+        inc result.unchangedFiles
+      else:
+        result.changedFiles.add cur.snap.path(j)
+        oldChanged[i] = true
+        newChanged[j] = true
+      inc i
+      inc j
+  old.indexChanged(oldChanged)
+  cur.indexChanged(newChanged)
+
+  for f in 0 ..< cur.snap.len:
+    if newChanged[f] and cur.snap.section(f).len > 0: result.visit(old, cur, f, 0, -1)
+  result.collectRemoved(old, cur)
+
+proc snapshotOf*(path: string): string =
+  ## `path` if it is a snapshot, else the project directory's snapshot, written or refreshed.
+  if fileExists(path): return path
+  result = path.normalizedPath & ".tm_snapshot"
+  discard writeSnapshot(path, result)
+
+proc diffProjects*(old, cur: string): ProjectDiff =
+  ## Object-level changes between two projects, each a directory or a snapshot.
+  diffSnapshots(snapshotOf(old), snapshotOf(cur))
+
+proc toJson*(d: ProjectDiff): JsonNode =
+  var objects = newJArray()
+  for c in d.objects:
+    var o = %*{"change": ($c.kind)[2 .. ^1].toLowerAscii, "uuid": $c.uuid, "type": c.typeName, "path": c.path}
+    if c.subobjects > 0: o["subobjects"] = %c.subobjects
+    if c.kind == ckModified:
+      var props = newJObject()
+      for p in c.properties: props[p.key] = %($p.kind)[2 .. ^1].toLowerAscii
+      o["properties"] = props
+    objects.add o
+  %*{
+    "added_files": d.addedFiles, "removed_files": d.removedFiles, "changed_files": d.changedFiles,
+    "unchanged_files": d.unchangedFiles, "compared": d.compared, "skipped": d.skipped,
+    "objects": objects
+  }
+
+when isMainModule:
+  var args = commandLineParams()
+  let asJson = "--json" in args
+  args = args.filterIt(it != "--json")
+  if args.len != 2:
+    quit "usage: tm_project_diff <old project or snapshot> <new project or snapshot> [--json]"
+  let start = getMonoTime()
+  let d = diffProjects(args[0], args[1])
+  if asJson:
+    echo d.toJson.pretty
+    quit(0)
+  const marks: array[ChangeKind, char] = ['+', '-', '~']
+  for path in d.addedFiles: echo &"+ {path}"
+  for path in d.removedFiles: echo &"- {path}"
+  for path in d.changedFiles: echo &"~ {path}"
+  for c in d.objects:
+    let nested = if c.subobjects > 0: &" (+{c.subobjects} subobjects)" else: ""
+    echo &"{marks[c.kind]} {c.uuid} {c.typeName} in {c.path}{nested}"
+    for p in c.properties: echo &"    {marks[p.kind]} {p.key}"
+  echo &"{d.objects.len} objects changed; {d.unchangedFiles} files unchanged, {d.skipped} subtrees " &
+    &"skipped by hash, {d.compared} compared in {(getMonoTime() - start).inMilliseconds} ms"
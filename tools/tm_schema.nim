@@ -0,0 +1,213 @@
+# Compiles a project's __type_index.tm_meta into a Nim module with, for every Truth type: its name
+# and type hash, a property enum whose ordinals are the property indices, a table of the property
+# definitions, and a record of its plain-value properties with the type's default as a constant.
+# Tools and plugins importing it get property indices and defaults at compile time, and
+# ``schemaMismatches`` (tm/foundation/truth_schema.nim) checks registered definitions against it.
+# The output is only rewritten when the type index changed.
+# Run with `nimble schema -- [project dir] [output module]`.
+import std / [os, sets, strformat, strutils, sequtils]
+import "../tm/foundation/murmur2"
+import tm_text, tm_project
+
+const HashLinePrefix = "# Type index hash: "
+
+type
+  SchemaKind* = enum
+    # Same order as tm_the_truth_property_type.
+    skNone = "none", skBool = "bool", skUint32 = "uint32_t", skUint64 = "uint64_t", skFloat = "float",
+    skDouble = "double", skString = "string", skBuffer = "buffer", skReference = "reference",
+    skSubobject = "subobject", skReferenceSet = "reference_set", skSubobjectSet = "subobject_set"
+
+  SchemaPropertyDef* = object
+    name*, ident*: string # ident: the Nim field and enum value name
+    kind*: SchemaKind
+    typeHash*: uint64
+    default*: string # Nim literal, empty if the type index has none
+
+  SchemaTypeDef* = object
+    name*, ident*: string
+    properties*: seq[SchemaPropertyDef]
+
+const
+  RecordKinds = {skBool .. skReference} # subobjects and sets are objects of their own
+  KindIdents: array[SchemaKind, string] = ["skNone", "skBool", "skUint32", "skUint64", "skFloat",
+    "skDouble", "skString", "skBuffer", "skReference", "skSubobject", "skReferenceSet", "skSubobjectSet"]
+  Keywords = ["addr", "and", "as", "asm", "bind", "block", "break", "case", "cast", "concept",
+    "const", "continue", "converter", "defer", "discard", "distinct", "div", "do", "elif", "else",
+    "end", "enum", "except", "export", "finally", "for", "from", "func", "if", "import", "in",
+    "include", "interface", "is", "isnot", "iterator", "let", "macro", "method", "mixin", "mod",
+    "nil", "not", "notin", "object", "of", "or", "out", "proc", "ptr", "raise", "ref", "return",
+    "shl", "shr", "static", "template", "try", "tuple", "type", "using", "var", "when", "while",
+    "xor", "yield"]
+
+proc nimIdent(name: string, capitalize: bool): string =
+  # `billboards-output_node_settings` -> BillboardsOutputNodeSettings, `blend_mode` -> blendMode.
+  var upper = capitalize
+  for c in name:
+    if c in IdentChars and c != '_':
+      result.add(if upper: c.toUpperAscii else: c)
+      upper = false
+    elif result.len > 0:
+      upper = true
+  if result.len == 0 or result[0] in Digits: result = (if capitalize: "T" else: "p") & result
+
+proc unique(ident: string, taken: var HashSet[string]): string =
+  # Nim identifiers compare ignoring case (but the first letter) and underscores.
+  result = ident
+  var n = 2
+  while nimIdentNormalize(result) in taken:
+    result = ident & $n
+    inc n
+  taken.incl nimIdentNormalize(result)
+
+proc quoted(ident: string): string =
+  if ident in Keywords: "`" & ident & "`" else: ident
+
+proc floatLiteral(x: float64, suffix: string): string =
+  if x != x: return "NaN"
+  if x == Inf: return "Inf"
+  if x == NegInf: return "NegInf"
+  result = $x
+  if not result.contains({'.', 'e', 'E'}): result.add ".0"
+  result.add suffix
+
+proc defaultLiteral(tree: TextTree, i: int32, kind: SchemaKind): string =
+  # The default in node `i` as a Nim literal, empty if it doesn't fit the property.
+  let n = tree[i]
+  case kind
+  of skBool:
+    if n.kind == nkBool: result = if n.number != 0: "true" else: "false"
+  of skFloat, skDouble:
+    if n.kind == nkNumber: result = floatLiteral(n.number, if kind == skFloat: "'f32" else: "")
+  of skUint32, skUint64, skBuffer:
+    let suffix = if kind == skUint32: "'u32" else: "'u64"
+    if n.kind == nkNumber and n.number >= 0:
+      let text = $n.text
+      result = (if text.allCharsInSet(Digits): text else: $uint64(n.number)) & suffix
+    elif n.kind == nkString and kind != skUint32:
+      let (ok, h) = parseHash(n.text.toOpenArray)
+      if ok: result = "0x" & hashString(h) & suffix
+  of skString:
+    if n.kind == nkString: result = tree.str(i).escape
+  of skReference:
+    if n.kind == nkUuid: result = &"SchemaUuid(a: 0x{n.uuid.a.toHex}'u64, b: 0x{n.uuid.b.toHex}'u64)"
+  else: discard
+
+proc readTypeIndex*(path: string): seq[SchemaTypeDef] =
+  ## The types listed in the type index at `path`, in its order. Raises IOError if it isn't one.
+  var f = openTextFile(path)
+  defer: f.close()
+  let tree = parseTree(f)
+  if tree.nodes.len == 0 or tree[0].kind != nkArray:
+    raise newException(IOError, &"{path}: not a type index")
+  var typeIdents = toHashSet(["SchemaKind", "SchemaProperty", "SchemaUuid"].mapIt(nimIdentNormalize(it)))
+  for t in tree.children(0):
+    let name = tree.child(t, "name")
+    if tree[t].kind != nkObject or name < 0:
+      raise newException(IOError, &"{path}: type without a name")
+    var def = SchemaTypeDef(name: tree.str(name))
+    def.ident = unique(nimIdent(def.name, true), typeIdents)
+    let props = tree.child(t, "properties")
+    let defaults = tree.child(t, "default")
+    var propIdents: HashSet[string]
+    if props >= 0:
+      for p in tree.children(props):
+        let (pname, ptype, phash) = (tree.child(p, "name"), tree.child(p, "type"), tree.child(p, "type_hash"))
+        if pname < 0 or ptype < 0:
+          raise newException(IOError, &"{path}: property of {def.name} without a name or type")
+        var prop = SchemaPropertyDef(name: tree.str(pname))
+        prop.ident = unique(nimIdent(prop.name, false), propIdents)
+        try:
+          prop.kind = parseEnum[SchemaKind](tree.str(ptype))
+        except ValueError:
+          raise newException(IOError, &"{path}: {def.name}.{prop.name} has unknown type {tree.str(ptype)}")
+        if phash >= 0: prop.typeHash = parseHash(tree[phash].text.toOpenArray)[1]
+        if defaults >= 0 and prop.kind in RecordKinds:
+          let d = tree.child(defaults, prop.name)
+          if d >= 0: prop.default = defaultLiteral(tree, d, prop.kind)
+        def.properties.add prop
+    result.add def
+
+proc fieldType(kind: SchemaKind): string =
+  case kind
+  of skBool: "bool"
+  of skUint32: "uint32"
+  of skUint64, skBuffer: "uint64" # buffers by their hash
+  of skFloat: "float32"
+  of skDouble: "float64"
+  of skString: "string"
+  of skReference: "SchemaUuid"
+  else: ""
+
+proc generateSchema*(types: openArray[SchemaTypeDef], source: string, sourceHash: uint64): string =
+  ## Nim source of the schema module for `types`.
+  result.add &"# Generated by tools/tm_schema.nim from {source}, don't edit.\n"
+  result.add HashLinePrefix & sourceHash.toHex.toLowerAscii & "\n\n"
+  result.add "type\n"
+  result.add "  SchemaKind* = enum\n"
+  result.add "    # Same order as tm_the_truth_property_type.\n"
+  result.add "    skNone, skBool, skUint32, skUint64, skFloat, skDouble, skString, skBuffer, skReference,\n"
+  result.add "    skSubobject, skReferenceSet, skSubobjectSet\n\n"
+  result.add "  SchemaProperty* = object\n"
+  result.add "    name*: string\n"
+  result.add "    kind*: SchemaKind\n"
+  result.add "    typeHash*: uint64 # allowed type of references and subobjects, 0 for any\n\n"
+  result.add "  SchemaUuid* = object\n"
+  result.add "    a*, b*: uint64\n"
+
+  for t in types:
+    result.add &"\n# {t.name}\n\n"
+    result.add &"const\n  {t.ident}TypeName* = {t.name.escape}\n"
+    result.add &"  {t.ident}TypeHash* = 0x{hashString(murmurHash64A(t.name))}'u64\n"
+    if t.properties.len == 0: continue
+
+    result.add &"\ntype\n  {t.ident}Prop* {{.pure.}} = enum\n"
+    for p in t.properties: result.add &"    {p.ident.quoted} = {p.name.escape}\n"
+    var hasFields = false
+    for p in t.properties:
+      if p.kind notin RecordKinds: continue
+      if not hasFields: result.add &"\n  {t.ident}* = object\n"
+      hasFields = true
+      result.add &"    {p.ident.quoted}*: {fieldType(p.kind)}\n"
+
+    result.add &"\nconst\n  {t.ident}Schema*: array[{t.ident}Prop, SchemaProperty] = [\n"
+    for p in t.properties:
+      let typeHash = if p.typeHash != 0: &", typeHash: 0x{hashString(p.typeHash)}'u64" else: ""
+      result.add &"    SchemaProperty(name: {p.name.escape}, kind: {KindIdents[p.kind]}{typeHash}),\n"
+    result.add "  ]\n"
+    if hasFields:
+      var defaults: seq[string]
+      for p in t.properties:
+        if p.default.len > 0: defaults.add &"{p.ident.quoted}: {p.default}"
+      let fields = defaults.join(", ")
+      result.add &"  {t.ident}Default* = {t.ident}({fields})\n"
+
+proc schemaHash*(path: string): uint64 =
+  ## Hash of the type index the schema module at `path` was generated from, 0 if there is none.
+  if not fileExists(path): return 0
+  for line in lines(path):
+    if line.startsWith(HashLinePrefix):
+      try: return fromHex[uint64](line[HashLinePrefix.len .. ^1])
+      except ValueError: return 0
+  0
+
+proc compileSchema*(projectDir, output: string): bool =
+  ## Writes the schema module of the project in `projectDir` to `output`, unless it is up to date.
+  ## Returns whether it wrote it.
+  let path = projectDir / TypeIndexFile
+  if not fileExists(path): raise newException(IOError, &"{path} doesn't exist")
+  let text = readFile(path)
+  let h = murmurHash64A(text)
+  if schemaHash(output) == h and h != 0: return false
+  let source = path.replace('\\', '/')
+  writeFile(output, generateSchema(readTypeIndex(path), source, h))
+  true
+
+when isMainModule:
+  let
+    dir = if paramCount() > 0: paramStr(1) else: "tm_proj"
+    output = if paramCount() > 1: paramStr(2) else: dir.normalizedPath & "_schema.nim"
+  if compileSchema(dir, output):
+    echo &"{output}: {readTypeIndex(dir / TypeIndexFile).len} types"
+  else:
+    echo &"{output}: up to date"
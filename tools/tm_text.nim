@@ -0,0 +1,417 @@
+# Zero-copy reader for The Machinery's text asset format (`*.tm_entity`, `*.tm_creation`, `*.tm_dir`,
+# `__type_index.tm_meta`, ...). Files are memory-mapped and tokenized in place: keys and strings are
+# slices of the mapping, numbers are parsed straight from it and UUID strings are decoded to their
+# two 64-bit halves, so nothing is allocated per token.
+import std / [memfiles, os, parseutils, hashes]
+
+type
+  Uuid* = object
+    ## Same layout as `tm_uuid_t`.
+    a*, b*: uint64
+
+  TextSlice* = object
+    ## Characters of a mapped file, only valid while the file is open.
+    p*: ptr UncheckedArray[char]
+    len*: int
+
+  TextFile* = object
+    ## A text asset mapped in memory. Empty files aren't mapped.
+    path*: string
+    mem: MemFile
+    data*: TextSlice
+
+  TokenKind* = enum
+    tkEnd         # end of the file
+    tkKey         # `text` is the property name, the next token is its value
+    tkObjectBegin # the root object has implied braces but still begins and ends
+    tkObjectEnd
+    tkArrayBegin
+    tkArrayEnd
+    tkString      # `text` is the content without quotes, `escaped` if it has backslash escapes
+    tkUuid        # a string holding a UUID, decoded to `uuid`
+    tkNumber      # `number`; `text` is the literal
+    tkBool        # `number` is 0 or 1
+
+  Token* = object
+    kind*: TokenKind
+    text*: TextSlice
+    number*: float64
+    uuid*: Uuid
+    escaped*: bool
+
+  TextTokenizer* = object
+    ## Pull tokenizer over a mapped file. The root is an object whose braces are implied, or an
+    ## array (the .tm_meta indexes). Raises ValueError with the file and line on malformed input.
+    ## Ex:
+    ## var f = openTextFile("tm_proj/core/camera.tm_entity")
+    ## var t = initTextTokenizer(f)
+    ## var tok: Token
+    ## while t.next(tok):
+    ##   if tok.kind == tkKey and tok.text == "__prototype_uuid": ...
+    ## f.close()
+    path: string
+    s: ptr UncheckedArray[char]
+    len, pos: int
+    containers: seq[bool] # open containers, *true* for objects
+    started, implicitRoot, done, afterKey: bool
+
+  NodeKind* = enum
+    nkObject, nkArray, nkString, nkUuid, nkNumber, nkBool
+
+  TextNode* = object
+    kind*: NodeKind
+    escaped*: bool # nkString
+    key*: TextSlice # property name, empty for array items and the root
+    text*: TextSlice # nkString, nkUuid, nkNumber: as in the file
+    number*: float64 # nkNumber, nkBool
+    uuid*: Uuid # nkUuid
+    parent*, next*, firstChild*: int32 # node indices, -1 if none
+    count*: int32 # number of children
+
+  TextTree* = object
+    ## Flat tree of a file's values, in file order; node 0 is the root. Slices point into the
+    ## mapped file.
+    nodes*: seq[TextNode]
+
+# --- Slices --------------------------------------------------------------------------------------
+
+template toOpenArray*(s: TextSlice): openArray[char] =
+  toOpenArray(s.p, 0, s.len - 1)
+
+proc `[]`*(s: TextSlice, i: int): char {.inline.} =
+  s.p[i]
+
+proc `==`*(s: TextSlice, str: string): bool {.inline.} =
+  s.len == str.len and (s.len == 0 or equalMem(s.p, str[0].unsafeAddr, s.len))
+
+proc `==`*(a, b: TextSlice): bool {.inline.} =
+  a.len == b.len and (a.len == 0 or equalMem(a.p, b.p, a.len))
+
+proc `$`*(s: TextSlice): string =
+  result = newString(s.len)
+  if s.len > 0: copyMem(result[0].addr, s.p, s.len)
+
+proc unescape*(s: TextSlice): string =
+  ## The string with its backslash escapes replaced.
+  var i = 0
+  while i < s.len:
+    if s.p[i] == '\\' and i + 1 < s.len:
+      inc i
+      result.add(case s.p[i]
+        of 'n': '\n'
+        of 't': '\t'
+        of 'r': '\r'
+        else: s.p[i])
+    else:
+      result.add s.p[i]
+    inc i
+
+proc hexValue(s: openArray[char]): (bool, uint64) =
+  for c in s:
+    let d = case c
+      of '0'..'9': ord(c) - ord('0')
+      of 'a'..'f': ord(c) - ord('a') + 10
+      else: return (false, 0'u64)
+    result[1] = result[1] shl 4 or d.uint64
+  result[0] = s.len > 0
+
+proc parseUuid*(s: openArray[char]): (bool, Uuid) =
+  ## "18b3ae96-1abf-bdcf-6e18-a5b500638249": `a` is the first 16 hex digits, `b` the last 16.
+  if s.len != 36 or s[8] != '-' or s[13] != '-' or s[18] != '-' or s[23] != '-': return
+  let
+    a0 = hexValue(s.toOpenArray(0, 7))
+    a1 = hexValue(s.toOpenArray(9, 12))
+    a2 = hexValue(s.toOpenArray(14, 17))
+    b0 = hexValue(s.toOpenArray(19, 22))
+    b1 = hexValue(s.toOpenArray(24, 35))
+  if a0[0] and a1[0] and a2[0] and b0[0] and b1[0]:
+    result = (true, Uuid(a: a0[1] shl 32 or a1[1] shl 16 or a2[1], b: b0[1] shl 48 or b1[1]))
+
+proc parseHash*(s: openArray[char]): (bool, uint64) =
+  ## Hashes are written as lowercase hex without leading zeros, so 8 to 16 digits not starting
+  ## with '0' round-trip exactly.
+  if s.len < 8 or s.len > 16 or s[0] == '0': return
+  hexValue(s)
+
+proc toHexDigits(x: uint64, digits: int): string =
+  const hex = "0123456789abcdef"
+  result = newString(digits)
+  for i in 0 ..< digits:
+    result[digits - 1 - i] = hex[int(x shr (4 * i)) and 15]
+
+proc `$`*(u: Uuid): string =
+  let
+    a = u.a.toHexDigits(16)
+    b = u.b.toHexDigits(16)
+  a[0..7] & '-' & a[8..11] & '-' & a[12..15] & '-' & b[0..3] & '-' & b[4..15]
+
+proc hash*(u: Uuid): Hash =
+  hash(u.a xor (u.b * 0x9E3779B97F4A7C15'u64))
+
+proc hashString*(h: uint64): string =
+  ## `h` as written in the text format, the inverse of ``parseHash``.
+  result = h.toHexDigits(16)
+  var i = 0
+  while i < 15 and result[i] == '0': inc i
+  result = result[i .. ^1]
+
+proc parseNumber*(s: openArray[char], number: var float64): bool =
+  ## Parses a number literal spanning all of `s`. Plain integers don't go through the float parser.
+  var
+    i = 0
+    neg = false
+    n = 0'u64
+  if s.len > 0 and s[0] == '-':
+    neg = true
+    inc i
+  if i < s.len and s.len - i <= 18:
+    while i < s.len and s[i] in {'0'..'9'}:
+      n = n * 10 + uint64(ord(s[i]) - ord('0'))
+      inc i
+    if i == s.len and s[s.len - 1] in {'0'..'9'}:
+      number = if neg: -float64(n) else: float64(n)
+      return true
+  var f: BiggestFloat
+  result = s.len > 0 and parseBiggestFloat(s, f) == s.len
+  number = f
+
+# --- Files ---------------------------------------------------------------------------------------
+
+proc openTextFile*(path: string): TextFile =
+  ## Maps the file at `path` read-only.
+  result.path = path
+  if getFileSize(path) > 0:
+    result.mem = memfiles.open(path)
+    result.data = TextSlice(p: cast[ptr UncheckedArray[char]](result.mem.mem), len: result.mem.size)
+
+proc close*(f: var TextFile) =
+  if f.data.p != nil:
+    f.mem.close()
+    f.data = TextSlice()
+
+# --- Tokenizer -----------------------------------------------------------------------------------
+
+proc initTextTokenizer*(data: TextSlice, path = ""): TextTokenizer =
+  ## `path` is only used in error messages.
+  TextTokenizer(path: path, s: data.p, len: data.len)
+
+proc initTextTokenizer*(f: TextFile): TextTokenizer =
+  initTextTokenizer(f.data, f.path)
+
+proc offset*(t: TextTokenizer): int {.inline.} =
+  ## Byte offset just past the last token.
+  t.pos
+
+proc line*(t: TextTokenizer): int =
+  ## Line of the current position, counted on demand.
+  result = 1
+  for i in 0 ..< min(t.pos, t.len):
+    if t.s[i] == '\n': inc result
+
+proc fail(t: TextTokenizer, msg: string) {.noreturn.} =
+  raise newException(ValueError, t.path & "(" & $t.line & "): " & msg)
+
+proc skipSpace(t: var TextTokenizer) {.inline.} =
+  while t.pos < t.len and t.s[t.pos] in {' ', '\t', '\r', '\n'}: inc t.pos
+
+proc slice(t: TextTokenizer, a, b: int): TextSlice {.inline.} =
+  TextSlice(p: cast[ptr UncheckedArray[char]](t.s[a].addr), len: b - a)
+
+proc next*(t: var TextTokenizer, tok: var Token): bool =
+  ## Reads the next token into `tok`. Returns *false* at the end of the file.
+  tok.escaped = false
+  if not t.started:
+    t.started = true
+    t.skipSpace()
+    if t.pos >= t.len or t.s[t.pos] != '[':
+      t.implicitRoot = true
+      t.containers.add true
+      tok.kind = tkObjectBegin
+      tok.text = TextSlice()
+      return true
+
+  t.skipSpace()
+  if t.pos >= t.len:
+    if t.afterKey: t.fail("expected a value")
+    if t.implicitRoot and t.containers.len == 1:
+      t.containers.setLen(0)
+      t.done = true
+      tok.kind = tkObjectEnd
+      return true
+    if t.containers.len > 0: t.fail("unexpected end of file")
+    tok.kind = tkEnd
+    return false
+  if t.done: t.fail("unexpected data after the root value")
+
+  let c = t.s[t.pos]
+  if not t.afterKey and t.containers.len > 0 and t.containers[^1]:
+    # In an object: a key or the end of the object.
+    if c == '}':
+      if t.implicitRoot and t.containers.len == 1: t.fail("unexpected '}'")
+      inc t.pos
+      t.containers.setLen(t.containers.len - 1)
+      tok.kind = tkObjectEnd
+      return true
+    let start = t.pos
+    while t.pos < t.len and t.s[t.pos] in IdentChars: inc t.pos
+    if t.pos == start: t.fail("expected a key")
+    tok.kind = tkKey
+    tok.text = t.slice(start, t.pos)
+    t.skipSpace()
+    if t.pos >= t.len or t.s[t.pos] != ':': t.fail("expected ':'")
+    inc t.pos
+    t.afterKey = true
+    return true
+
+  let expectValue = t.afterKey
+  t.afterKey = false
+  case c
+  of '{', '[':
+    inc t.pos
+    t.containers.add(c == '{')
+    tok.kind = if c == '{': tkObjectBegin else: tkArrayBegin
+    tok.text = TextSlice()
+  of ']':
+    if expectValue or t.containers.len == 0: t.fail("unexpected ']'")
+    inc t.pos
+    t.containers.setLen(t.containers.len - 1)
+    t.done = t.containers.len == 0
+    tok.kind = tkArrayEnd
+    tok.text = TextSlice()
+  of '}':
+    t.fail("unexpected '}'")
+  of '"':
+    inc t.pos
+    let start = t.pos
+    while t.pos < t.len and t.s[t.pos] != '"':
+      if t.s[t.pos] == '\\':
+        tok.escaped = true
+        inc t.pos
+      inc t.pos
+    if t.pos >= t.len: t.fail("unterminated string")
+    tok.text = t.slice(start, t.pos)
+    inc t.pos
+    tok.kind = tkString
+    if tok.text.len == 36 and not tok.escaped:
+      let (isUuid, u) = parseUuid(tok.text.toOpenArray)
+      if isUuid:
+        tok.kind = tkUuid
+        tok.uuid = u
+  else:
+    let start = t.pos
+    while t.pos < t.len and t.s[t.pos] notin {' ', '\t', '\r', '\n', '{', '}', '[', ']', '"'}: inc t.pos
+    tok.text = t.slice(start, t.pos)
+    if tok.text == "true" or tok.text == "false":
+      tok.kind = tkBool
+      tok.number = if tok.text.len == 4: 1.0 else: 0.0
+    else:
+      tok.kind = tkNumber
+      if tok.text == "inf": tok.number = Inf
+      elif tok.text == "-inf": tok.number = NegInf
+      elif tok.text == "nan" or tok.text == "-nan": tok.number = NaN
+      elif not parseNumber(tok.text.toOpenArray, tok.number):
+        t.fail("bad value '" & $tok.text & "'")
+  if t.containers.len == 0: t.done = true
+  true
+
+proc skipValue*(t: var TextTokenizer, tok: var Token) =
+  ## After reading the first token of a value, skips the rest of it.
+  var depth = 0
+  if tok.kind in {tkObjectBegin, tkArrayBegin}: depth = 1
+  while depth > 0 and t.next(tok):
+    case tok.kind
+    of tkObjectBegin, tkArrayBegin: inc depth
+    of tkObjectEnd, tkArrayEnd: dec depth
+    else: discard
+
+# --- Tree ----------------------------------------------------------------------------------------
+
+proc parseTree*(t: var TextTokenizer, tree: var TextTree) =
+  ## Reads the whole file into `tree`, reusing its node storage.
+  tree.nodes.setLen(0)
+  var
+    tok: Token
+    key: TextSlice
+    open: seq[(int32, int32)] # (container, its last child)
+  while t.next(tok):
+    case tok.kind
+    of tkKey:
+      key = tok.text
+      continue
+    of tkObjectEnd, tkArrayEnd:
+      open.setLen(open.len - 1)
+      continue
+    of tkEnd: break
+    else: discard
+    let i = tree.nodes.len.int32
+    var n = TextNode(key: key, parent: -1, next: -1, firstChild: -1)
+    key = TextSlice()
+    case tok.kind
+    of tkObjectBegin: n.kind = nkObject
+    of tkArrayBegin: n.kind = nkArray
+    of tkString:
+      n.kind = nkString
+      n.text = tok.text
+      n.escaped = tok.escaped
+    of tkUuid:
+      n.kind = nkUuid
+      n.text = tok.text
+      n.uuid = tok.uuid
+    of tkNumber, tkBool:
+      n.kind = if tok.kind == tkNumber: nkNumber else: nkBool
+      n.text = tok.text
+      n.number = tok.number
+    else: discard
+    if open.len > 0:
+      let (parent, last) = open[^1]
+      n.parent = parent
+      if last < 0: tree.nodes[parent].firstChild = i else: tree.nodes[last].next = i
+      open[^1][1] = i
+      inc tree.nodes[parent].count
+    tree.nodes.add n
+    if tok.kind in {tkObjectBegin, tkArrayBegin}: open.add (i, -1'i32)
+
+proc parseTree*(f: TextFile): TextTree =
+  var t = initTextTokenizer(f)
+  t.parseTree(result)
+
+proc `[]`*(tree: TextTree, i: int32): lent TextNode {.inline.} =
+  tree.nodes[i]
+
+iterator children*(tree: TextTree, i: int32): int32 =
+  var c = tree.nodes[i].firstChild
+  while c >= 0:
+    yield c
+    c = tree.nodes[c].next
+
+proc child*(tree: TextTree, i: int32, key: string): int32 =
+  ## Property `key` of the object node `i`, -1 if it isn't set.
+  for c in tree.children(i):
+    if tree.nodes[c].key == key: return c
+  -1
+
+proc str*(tree: TextTree, i: int32): string =
+  ## String value of node `i`, unescaped.
+  let n = tree.nodes[i].addr
+  if n.escaped: unescape(n.text) else: $n.text
+
+when isMainModule:
+  # Tokenizes every text asset under a directory and reports the throughput.
+  import std / [monotimes, times, strutils]
+  let dir = if paramCount() > 0: paramStr(1) else: "tm_proj"
+  var
+    files, tokens, bytes = 0
+    tok: Token
+  let start = getMonoTime()
+  for path in walkDirRec(dir):
+    let ext = path.splitFile.ext
+    if not ext.startsWith(".tm_") or ext == ".tm_buffers" or ".tm_buffers" in path.parentDir: continue
+    var f = openTextFile(path)
+    var t = initTextTokenizer(f)
+    while t.next(tok): inc tokens
+    bytes += f.data.len
+    inc files
+    f.close()
+  let elapsed = (getMonoTime() - start).inMicroseconds
+  echo dir, ": ", files, " files, ", tokens, " tokens, ", bytes, " bytes in ", elapsed, " us (",
+    formatFloat(files.float * 1e6 / max(elapsed, 1).float, ffDecimal, 0), " files/s)"
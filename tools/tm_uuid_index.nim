@@ -0,0 +1,414 @@
+# Project-wide index of the objects in a project's text assets: every `__uuid` with its file, byte
+# offset and type, plus the prototype (`__prototype_uuid`) and reference edges between objects. The
+# index is a sorted, memory-mapped table, so "what does this object inherit from" and "who
+# references this UUID" are binary searches instead of opening asset files. Files are scanned in
+# parallel; a refresh only lists directories whose mtime changed and only rescans files whose mtime
+# changed.
+# Run with `nimble uuidindex -- [project dir] [index file] [uuid...]`.
+import std / [os, memfiles, tables, algorithm, times, monotimes, strformat, strutils]
+import tm_text, tm_project, work_pool
+
+const
+  IndexMagic = ['T', 'M', 'U', 'U', 'I', 'D', 'X', '1']
+  NoType* = high(uint32)
+
+type
+  RefKind* {.size: sizeof(uint32).} = enum
+    rkReference # a reference property or set
+    rkPrototype # `__prototype_uuid`
+
+  IndexEntry* = object
+    uuid*, prototype*: Uuid # prototype is zero if the object doesn't have one
+    offset*: uint64 # byte offset of the object's `{` in its file, 0 for the file's root object
+    file*: uint32
+    typ*: uint32 # type name index, NoType if the object has no `__type` or `__prototype_type`
+
+  IndexRef* = object
+    target*, source*: Uuid # `source` is the closest object with a `__uuid` holding the reference
+    kind*: RefKind
+    file*: uint32
+
+  IndexName = object
+    offset, len: uint32
+
+  IndexFile = object
+    name: IndexName # project-relative path
+    mtime: int64
+    dir: uint32
+    padding: uint32
+
+  IndexDir = object
+    name: IndexName # project-relative path, "" for the root
+    mtime: int64
+
+  IndexHeader = object
+    magic: array[8, char]
+    numFiles, numDirs, numEntries, numRefs, numTypes, padding: uint32
+    filesOffset, dirsOffset, entriesOffset, refsOffset, typesOffset, namesOffset: uint64
+
+  UuidIndex* = object
+    ## A mapped index file. Entries are sorted by uuid, references by target.
+    ## Ex:
+    ## var ix = openUuidIndex("tm_proj.tm_uuid_index")
+    ## for e in ix.prototypeChain(uuid): echo ix.path(e.file), " ", ix.typeName(e.typ)
+    ## for r in ix.referencers(uuid): echo r.source
+    mem: MemFile
+    header: ptr IndexHeader
+
+  UuidIndexStats* = object
+    files*, scanned*, reused*, dirsListed*, entries*, refs*: int
+
+static:
+  doAssert sizeof(IndexEntry) == 48
+  doAssert sizeof(IndexRef) == 40
+  doAssert sizeof(IndexHeader) == 80
+
+proc `<`*(a, b: Uuid): bool {.inline.} =
+  a.a < b.a or (a.a == b.a and a.b < b.b)
+
+proc cmp*(a, b: Uuid): int {.inline.} =
+  if a < b: -1 elif a == b: 0 else: 1
+
+proc isNil(u: Uuid): bool {.inline.} =
+  u.a == 0 and u.b == 0
+
+# --- Scanning ------------------------------------------------------------------------------------
+
+type
+  FileScan = object
+    entries: seq[IndexEntry] # `typ` indexes `types`
+    refs: seq[IndexRef]
+    types: seq[string]
+    error: string
+
+  ScanJob = object
+    dir: string
+    paths: seq[string] # project-relative
+    files: seq[uint32] # index file of each path
+    scans: seq[FileScan]
+
+proc typeId(scan: var FileScan, name: TextSlice): uint32 =
+  # Files use a handful of types, a linear search beats hashing.
+  for i, t in scan.types:
+    if name == t: return i.uint32
+  scan.types.add $name
+  scan.types.high.uint32
+
+proc scanFile(path: string, file: uint32, scan: var FileScan) =
+  var f = openTextFile(path)
+  defer: f.close()
+  var
+    t = initTextTokenizer(f)
+    tok: Token
+    key: TextSlice
+    open: seq[int] # entries of the open objects
+    parents: seq[int] # of each entry, -1 for the root
+    sources: seq[int] # entry holding each reference
+  while t.next(tok):
+    if tok.kind == tkKey:
+      key = tok.text
+      continue
+    case tok.kind
+    of tkObjectBegin:
+      let offset = if open.len == 0: 0'u64 else: uint64(t.offset - 1)
+      scan.entries.add IndexEntry(offset: offset, file: file, typ: NoType)
+      parents.add(if open.len > 0: open[^1] else: -1)
+      open.add scan.entries.high
+    of tkObjectEnd:
+      open.setLen(open.len - 1)
+    of tkUuid:
+      if open.len == 0: continue
+      let o = open[^1]
+      if key == "__uuid":
+        scan.entries[o].uuid = tok.uuid
+      else:
+        let kind = if key == "__prototype_uuid": rkPrototype else: rkReference
+        if kind == rkPrototype: scan.entries[o].prototype = tok.uuid
+        scan.refs.add IndexRef(target: tok.uuid, kind: kind, file: file)
+        sources.add o
+    of tkString:
+      if open.len == 0: discard
+      elif key == "__type":
+        scan.entries[open[^1]].typ = scan.typeId(tok.text)
+      elif key == "__prototype_type" and scan.entries[open[^1]].typ == NoType:
+        scan.entries[open[^1]].typ = scan.typeId(tok.text)
+    else: discard
+    key = TextSlice()
+
+  # Objects without a __uuid (such as set wrappers) pass their references on to their owner.
+  for r, s in sources:
+    var o = s
+    while o >= 0 and scan.entries[o].uuid.isNil: o = parents[o]
+    if o >= 0: scan.refs[r].source = scan.entries[o].uuid
+  var n = 0
+  for e in scan.entries:
+    if not e.uuid.isNil:
+      scan.entries[n] = e
+      inc n
+  scan.entries.setLen(n)
+
+proc scanOne(job: ptr ScanJob, i, worker: int) {.nimcall, gcsafe.} =
+  try:
+    scanFile(job.dir / job.paths[i], job.files[i], job.scans[i])
+  except CatchableError as e:
+    job.scans[i].error = e.msg
+
+# --- Index file ----------------------------------------------------------------------------------
+
+proc at[T](ix: UuidIndex, offset: uint64): ptr UncheckedArray[T] {.inline.} =
+  cast[ptr UncheckedArray[T]](cast[uint](ix.mem.mem) + offset.uint)
+
+proc openUuidIndex*(path: string): UuidIndex =
+  ## Maps the index at `path`. Raises IOError if it isn't an index.
+  result.mem = memfiles.open(path)
+  result.header = cast[ptr IndexHeader](result.mem.mem)
+  if result.mem.size < sizeof(IndexHeader) or result.header.magic != IndexMagic:
+    result.mem.close()
+    raise newException(IOError, &"{path} is not a uuid index")
+
+proc close*(ix: var UuidIndex) =
+  if ix.header != nil:
+    ix.mem.close()
+    ix.header = nil
+
+proc name(ix: UuidIndex, n: IndexName): string =
+  result = newString(n.len.int)
+  if n.len > 0: copyMem(result[0].addr, ix.at[:char](ix.header.namesOffset + n.offset)[0].addr, n.len.int)
+
+proc numFiles*(ix: UuidIndex): int {.inline.} = ix.header.numFiles.int
+proc numEntries*(ix: UuidIndex): int {.inline.} = ix.header.numEntries.int
+proc numRefs*(ix: UuidIndex): int {.inline.} = ix.header.numRefs.int
+
+proc path*(ix: UuidIndex, file: uint32): string =
+  ix.name(ix.at[:IndexFile](ix.header.filesOffset)[file].name)
+
+proc typeName*(ix: UuidIndex, typ: uint32): string =
+  if typ >= ix.header.numTypes: return ""
+  ix.name(ix.at[:IndexName](ix.header.typesOffset)[typ])
+
+proc entry*(ix: UuidIndex, i: int): ptr IndexEntry {.inline.} =
+  ix.at[:IndexEntry](ix.header.entriesOffset)[i].addr
+
+proc reference*(ix: UuidIndex, i: int): ptr IndexRef {.inline.} =
+  ix.at[:IndexRef](ix.header.refsOffset)[i].addr
+
+proc find*(ix: UuidIndex, uuid: Uuid): ptr IndexEntry =
+  ## The object with `uuid`, nil if it isn't in the project.
+  var
+    lo = 0
+    hi = ix.numEntries
+  while lo < hi:
+    let mid = (lo + hi) div 2
+    if ix.entry(mid).uuid < uuid: lo = mid + 1 else: hi = mid
+  if lo < ix.numEntries and ix.entry(lo).uuid == uuid: ix.entry(lo) else: nil
+
+iterator prototypeChain*(ix: UuidIndex, uuid: Uuid): ptr IndexEntry =
+  ## The object with `uuid`, then its prototype, its prototype's prototype and so on, as long as
+  ## they are in the project.
+  var
+    e = ix.find(uuid)
+    depth = 0
+  while e != nil and depth < 64: # cycles are broken assets, don't hang on them
+    yield e
+    e = if e.prototype.isNil: nil else: ix.find(e.prototype)
+    inc depth
+
+iterator referencers*(ix: UuidIndex, uuid: Uuid): ptr IndexRef =
+  ## Every reference to `uuid`, including objects using it as their prototype.
+  var
+    lo = 0
+    hi = ix.numRefs
+  while lo < hi:
+    let mid = (lo + hi) div 2
+    if ix.reference(mid).target < uuid: lo = mid + 1 else: hi = mid
+  while lo < ix.numRefs and ix.reference(lo).target == uuid:
+    yield ix.reference(lo)
+    inc lo
+
+proc writeAll[T](f: File, data: openArray[T]) =
+  if data.len > 0 and f.writeBuffer(data[0].unsafeAddr, data.len * sizeof(T)) != data.len * sizeof(T):
+    raise newException(IOError, "failed writing uuid index")
+
+# --- Building ------------------------------------------------------------------------------------
+
+proc dirOf(relPath: string): string =
+  result = relPath.parentDir.replace('\\', '/')
+  if result == ".": result = ""
+
+proc listProject(dir: string, old: UuidIndex, stats: var UuidIndexStats):
+    tuple[files: seq[string], dirs: seq[(string, int64)]] =
+  # Asset files and directories of the project. Directories whose mtime matches the old index have
+  # the same entries as then, so their files and subdirectories are taken from the index.
+  var
+    oldDirs: Table[string, int64]
+    oldFiles, oldSubdirs: Table[string, seq[string]]
+  if old.header != nil:
+    for i in 0 ..< old.header.numDirs.int:
+      let d = old.at[:IndexDir](old.header.dirsOffset)[i]
+      let name = old.name(d.name)
+      oldDirs[name] = d.mtime
+      if name.len > 0: oldSubdirs.mgetOrPut(name.dirOf, @[]).add name
+    for i in 0 ..< old.numFiles:
+      let f = old.at[:IndexFile](old.header.filesOffset)[i]
+      oldFiles.mgetOrPut(old.name(old.at[:IndexDir](old.header.dirsOffset)[f.dir].name), @[]).add old.name(f.name)
+
+  var pending = @[""]
+  while pending.len > 0:
+    let
+      rel = pending.pop()
+      mtime = mtimeOf(if rel.len == 0: dir else: dir / rel)
+    result.dirs.add (rel, mtime)
+    if oldDirs.getOrDefault(rel, -1) == mtime:
+      result.files.add oldFiles.getOrDefault(rel)
+      pending.add oldSubdirs.getOrDefault(rel)
+      continue
+    inc stats.dirsListed
+    for kind, path in walkDir(if rel.len == 0: dir else: dir / rel, relative = true):
+      let p = if rel.len == 0: path else: rel & "/" & path
+      if kind == pcDir and not p.endsWith(BuffersExt): pending.add p
+      elif kind == pcFile and p.isAssetFile: result.files.add p
+  result.files.sort()
+  result.dirs.sort(proc (a, b: (string, int64)): int = cmp(a[0], b[0]))
+
+proc buildUuidIndex*(dir, indexPath: string, workers = 0): UuidIndexStats =
+  ## Builds or refreshes the index of the project in `dir`. Files whose mtime matches the index
+  ## already at `indexPath` keep their entries.
+  var old: UuidIndex
+  if fileExists(indexPath):
+    try: old = openUuidIndex(indexPath)
+    except IOError, OSError: discard
+  try:
+    let (paths, dirs) = listProject(dir, old, result)
+    var dirIds: Table[string, uint32]
+    for i, d in dirs: dirIds[d[0]] = i.uint32
+
+    # Unchanged files keep their old entries and references, the others are scanned.
+    var
+      oldFileIds: Table[string, (uint32, int64)]
+      reuse = newSeq[int](paths.len) # old file id or -1
+      job = ScanJob(dir: dir)
+      files = newSeq[IndexFile](paths.len)
+      mtimes = newSeq[int64](paths.len)
+    if old.header != nil:
+      for i in 0 ..< old.numFiles:
+        let f = old.at[:IndexFile](old.header.filesOffset)[i]
+        oldFileIds[old.name(f.name)] = (i.uint32, f.mtime)
+    for i, p in paths:
+      mtimes[i] = mtimeOf(dir / p)
+      let (id, mtime) = oldFileIds.getOrDefault(p, (high(uint32), 0'i64))
+      if id != high(uint32) and mtime == mtimes[i]:
+        reuse[i] = id.int
+      else:
+        reuse[i] = -1
+        job.paths.add p
+        job.files.add i.uint32
+    job.scans.setLen(job.paths.len)
+    parallelFor(job.addr, job.paths.len, scanOne, workers)
+    result.files = paths.len
+    result.scanned = job.paths.len
+    result.reused = paths.len - job.paths.len
+
+    var
+      entries: seq[IndexEntry]
+      refs: seq[IndexRef]
+      types: seq[string]
+      typeIds: Table[string, uint32]
+    proc globalType(name: string): uint32 =
+      result = typeIds.getOrDefault(name, NoType)
+      if result == NoType:
+        result = types.len.uint32
+        types.add name
+        typeIds[name] = result
+    for scan in job.scans.mitems:
+      if scan.error.len > 0:
+        stderr.writeLine scan.error
+        continue
+      for e in scan.entries.mitems:
+        if e.typ != NoType: e.typ = globalType(scan.types[e.typ])
+      entries.add scan.entries
+      refs.add scan.refs
+    if old.header != nil and result.reused > 0:
+      var newId = initTable[uint32, uint32]()
+      for i, r in reuse:
+        if r >= 0: newId[r.uint32] = i.uint32
+      for i in 0 ..< old.numEntries:
+        var e = old.entry(i)[]
+        newId.withValue(e.file, id):
+          e.file = id[]
+          if e.typ != NoType: e.typ = globalType(old.typeName(e.typ))
+          entries.add e
+      for i in 0 ..< old.numRefs:
+        var r = old.reference(i)[]
+        newId.withValue(r.file, id):
+          r.file = id[]
+          refs.add r
+    entries.sort(proc (a, b: IndexEntry): int = cmp(a.uuid, b.uuid))
+    refs.sort(proc (a, b: IndexRef): int =
+      result = cmp(a.target, b.target)
+      if result == 0: result = cmp(a.source, b.source))
+    result.entries = entries.len
+    result.refs = refs.len
+
+    # Names blob: file paths, directory paths, type names.
+    var names: string
+    proc addName(s: string): IndexName =
+      result = IndexName(offset: names.len.uint32, len: s.len.uint32)
+      names.add s
+    for i, p in paths:
+      files[i] = IndexFile(name: addName(p), mtime: mtimes[i], dir: dirIds.getOrDefault(p.dirOf))
+    for k, scan in job.scans:
+      # Failed files have no entries; mtime 0 gets them scanned again on the next refresh.
+      if scan.error.len > 0: files[job.files[k]].mtime = 0
+    var indexDirs = newSeq[IndexDir](dirs.len)
+    for i, d in dirs: indexDirs[i] = IndexDir(name: addName(d[0]), mtime: d[1])
+    var typeNames = newSeq[IndexName](types.len)
+    for i, t in types: typeNames[i] = addName(t)
+
+    var h = IndexHeader(magic: IndexMagic, numFiles: files.len.uint32, numDirs: dirs.len.uint32,
+      numEntries: entries.len.uint32, numRefs: refs.len.uint32, numTypes: types.len.uint32)
+    h.filesOffset = sizeof(IndexHeader).uint64
+    h.dirsOffset = h.filesOffset + uint64(files.len * sizeof(IndexFile))
+    h.entriesOffset = h.dirsOffset + uint64(dirs.len * sizeof(IndexDir))
+    h.refsOffset = h.entriesOffset + uint64(entries.len * sizeof(IndexEntry))
+    h.typesOffset = h.refsOffset + uint64(refs.len * sizeof(IndexRef))
+    h.namesOffset = h.typesOffset + uint64(types.len * sizeof(IndexName))
+    var f = open(indexPath & ".tmp", fmWrite)
+    try:
+      f.writeAll([h])
+      f.writeAll(files)
+      f.writeAll(indexDirs)
+      f.writeAll(entries)
+      f.writeAll(refs)
+      f.writeAll(typeNames)
+      f.writeAll(names.toOpenArray(0, names.high))
+    finally:
+      f.close()
+  finally:
+    old.close()
+  moveFile(indexPath & ".tmp", indexPath)
+
+when isMainModule:
+  let
+    args = commandLineParams()
+    dir = if args.len > 0: args[0] else: "tm_proj"
+    indexPath = if args.len > 1: args[1] else: dir.normalizedPath & ".tm_uuid_index"
+
+  let start = getMonoTime()
+  let stats = buildUuidIndex(dir, indexPath)
+  echo &"{indexPath}: {stats.files} files ({stats.scanned} scanned, {stats.reused} reused, " &
+    &"{stats.dirsListed} directories listed), {stats.entries} objects, {stats.refs} references " &
+    &"in {(getMonoTime() - start).inMilliseconds} ms"
+
+  var ix = openUuidIndex(indexPath)
+  for arg in args[min(2, args.len) .. ^1]:
+    let (ok, uuid) = parseUuid(arg)
+    if not ok:
+      echo &"{arg}: not a uuid"
+      continue
+    echo arg, ":"
+    for e in ix.prototypeChain(uuid):
+      echo &"  {e.uuid} {ix.typeName(e.typ)} in {ix.path(e.file)} at {e.offset}"
+    for r in ix.referencers(uuid):
+      let e = ix.find(r.source)
+      echo &"  <- {r.kind} from {r.source} ({ix.typeName(if e != nil: e.typ else: NoType)}) in {ix.path(r.file)}"
+  ix.close()
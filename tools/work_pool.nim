@@ -0,0 +1,74 @@
+# Work-stealing parallel loop for the offline tools. Items are split into one contiguous range per
+# worker; a worker that finishes its range steals the remaining items of the others one at a time.
+# Runs on the calling thread when built without `--threads:on`.
+import std / [cpuinfo, atomics]
+when compileOption("threads"):
+  when (NimMajor, NimMinor) >= (1, 9):
+    import std / typedthreads
+
+type
+  WorkBody*[C] = proc (ctx: ptr C, item, worker: int) {.nimcall, gcsafe.}
+
+  WorkRange = object
+    next: Atomic[int]
+    last: int # exclusive
+    padding: array[48, byte] # one range per cache line, workers hammer their own `next`
+
+  WorkPool[C] = object
+    ctx: ptr C
+    body: WorkBody[C]
+    ranges: seq[WorkRange]
+
+  WorkerArg[C] = object
+    pool: ptr WorkPool[C]
+    worker: int
+
+proc workerCount*(workers = 0): int =
+  ## `workers`, or one per core if 0.
+  if workers > 0: workers else: max(1, countProcessors())
+
+proc poolSize*(n: int, workers = 0): int =
+  ## Number of workers ``parallelFor`` uses for `n` items, to size per-worker results up front.
+  when compileOption("threads"):
+    if n <= 1: 1 else: min(workerCount(workers), n)
+  else:
+    1
+
+proc claim(r: var WorkRange): int {.inline.} =
+  let i = r.next.fetchAdd(1, moRelaxed)
+  if i < r.last: i else: -1
+
+proc runWorker[C](a: ptr WorkerArg[C]) {.thread.} =
+  let p = a.pool
+  for k in 0 ..< p.ranges.len:
+    # Own range first, then the others in order, so thieves spread over different victims.
+    let w = (a.worker + k) mod p.ranges.len
+    while true:
+      let i = p.ranges[w].claim()
+      if i < 0: break
+      p.body(p.ctx, i, a.worker)
+
+proc parallelFor*[C](ctx: ptr C, n: int, body: WorkBody[C], workers = 0): int {.discardable.} =
+  ## Calls `body(ctx, i, worker)` for every `i` in `0 ..< n`, on `workers` threads. `worker` is
+  ## in `0 ..< poolSize(n, workers)`, which is returned, and can index per-worker results. Order
+  ## is unspecified.
+  ## Ex:
+  ## var hashes = newSeq[uint64](files.len)
+  ## parallelFor(hashes.addr, files.len, proc (h: ptr seq[uint64], i, w: int) = h[][i] = hashFile(i))
+  result = poolSize(n, workers)
+  var pool = WorkPool[C](ctx: ctx, body: body)
+  pool.ranges = newSeq[WorkRange](result)
+  for w in 0 ..< result:
+    pool.ranges[w].next.store(n * w div result)
+    pool.ranges[w].last = n * (w + 1) div result
+  var args = newSeq[WorkerArg[C]](result)
+  for w in 0 ..< result:
+    args[w] = WorkerArg[C](pool: pool.addr, worker: w)
+  when compileOption("threads"):
+    if result > 1:
+      var threads = newSeq[Thread[ptr WorkerArg[C]]](result)
+      for w in 0 ..< result:
+        createThread(threads[w], runWorker[C], args[w].addr)
+      joinThreads(threads)
+      return
+  runWorker(args[0].addr)